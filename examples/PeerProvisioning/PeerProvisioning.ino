@@ -0,0 +1,48 @@
+/*
+ * Provisions a fleet: flash every device with this sketch and the same FLEET_KEY, then provision
+ * one of them over serial. It hands the credentials over ESP-NOW to the devices without credentials,
+ * which pass them on in turn.
+ */
+
+#include <WiFi.h>
+#include "ImprovWiFiLibrary.h"
+#include "ImprovEspNowLink.h"
+#include "ImprovPeerProvisioning.h"
+
+// shared by all devices of the fleet, keep it out of version control
+const uint8_t FLEET_KEY[32] = {
+  0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+  0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F};
+
+ImprovWiFi improvSerial(&Serial);
+ImprovEspNowLink peerLink;
+ImprovPeerProvisioning peers(improvSerial);
+
+void onImprovWiFiConnectedCb(const char *ssid, const char *password)
+{
+  Serial.printf("Provisioned for %s\n", ssid);
+}
+
+void setup()
+{
+  Serial.begin(115200);
+
+  WiFi.mode(WIFI_STA);
+  WiFi.disconnect();
+
+  improvSerial.setDeviceInfo(ImprovTypes::ChipFamily::CF_ESP32, "ImprovWiFiLib", "1.0.0", "PeerProvisioning");
+  improvSerial.onImprovConnected(onImprovWiFiConnectedCb);
+  improvSerial.setWriteBehindPersistence(true);
+  improvSerial.ConnectToWifi();
+
+  if (!peers.begin(&peerLink, FLEET_KEY, sizeof(FLEET_KEY)))
+  {
+    Serial.println("Peer provisioning not available");
+  }
+}
+
+void loop()
+{
+  improvSerial.loop();
+  peers.loop();
+}
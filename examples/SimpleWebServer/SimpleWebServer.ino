@@ -73,6 +73,7 @@ void setup()
   //improvSerial.setCustomConnectWiFi(connectWifi);  // Optional
   //improvSerial.setCustomWiFiCredentialSaving(saveWifiCredentials); // Optional
   //improvSerial.setCustomWiFiCredentialLoading(loadWifiCredentials); // Optional
+  //improvSerial.setBaudRateSwitching(115200, 921600, [](uint32_t baud) { Serial.updateBaudRate(baud); return true; }); // Optional
   improvSerial.ConnectToWifi();
 
   blink_led(100, 5);
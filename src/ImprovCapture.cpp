@@ -0,0 +1,175 @@
+#include "ImprovCapture.h"
+
+#include <algorithm>
+#include <cstring>
+
+static ImprovSystemClock systemClock;
+
+ImprovCaptureStream::ImprovCaptureStream(Stream *stream, Print *log, ImprovClock *clock):
+  stream(stream),
+  log(log),
+  clock(clock ? clock : &systemClock)
+{
+
+}
+
+int ImprovCaptureStream::available()
+{
+  return stream->available();
+}
+
+int ImprovCaptureStream::read()
+{
+  int b = stream->read();
+  if (b >= 0)
+  {
+    uint8_t byte = b;
+    record(CAPTURE_IN, &byte, 1);
+  }
+  return b;
+}
+
+int ImprovCaptureStream::peek()
+{
+  return stream->peek();
+}
+
+size_t ImprovCaptureStream::write(uint8_t byte)
+{
+  return write(&byte, 1);
+}
+
+size_t ImprovCaptureStream::write(const uint8_t *buffer, size_t size)
+{
+  size_t written = stream->write(buffer, size);
+  record(CAPTURE_OUT, buffer, written);
+  return written;
+}
+
+void ImprovCaptureStream::flush()
+{
+  flushChunk();
+  log->flush();
+  stream->flush();
+}
+
+void ImprovCaptureStream::record(Direction direction, const uint8_t *data, size_t size)
+{
+  uint64_t now = clock->millis64();
+
+  if (chunkLength && (direction != chunkDirection || now != chunkTime))
+    flushChunk();
+
+  while (size)
+  {
+    if (chunkLength == 0)
+    {
+      chunkDirection = direction;
+      chunkTime = now;
+    }
+
+    size_t n = std::min<size_t>(size, IMPROV_CAPTURE_CHUNK - chunkLength);
+    memcpy(&chunk[chunkLength], data, n);
+    chunkLength += n;
+    data += n;
+    size -= n;
+
+    if (chunkLength == IMPROV_CAPTURE_CHUNK)
+      flushChunk();
+  }
+}
+
+void ImprovCaptureStream::flushChunk()
+{
+  if (chunkLength == 0)
+    return;
+
+  if (!headerWritten)
+  {
+    const uint8_t header[] = {'I', 'M', 'P', 'C', 'A', 'P', 1};
+    log->write(header, sizeof(header));
+    headerWritten = true;
+    lastRecord = chunkTime;
+  }
+
+  log->write((uint8_t)chunkDirection);
+  writeVarint(chunkTime - lastRecord);
+  writeVarint(chunkLength);
+  log->write(chunk, chunkLength);
+
+  lastRecord = chunkTime;
+  chunkLength = 0;
+}
+
+void ImprovCaptureStream::writeVarint(uint64_t value)
+{
+  uint8_t buffer[10];
+  uint8_t length = 0;
+
+  do
+  {
+    buffer[length] = value & 0x7F;
+    value >>= 7;
+    if (value)
+      buffer[length] |= 0x80;
+    length++;
+  } while (value);
+
+  log->write(buffer, length);
+}
+
+ImprovCaptureReader::ImprovCaptureReader(const uint8_t *data, size_t length):
+  data(data),
+  length(length)
+{
+  const uint8_t header[] = {'I', 'M', 'P', 'C', 'A', 'P', 1};
+
+  // an empty capture is valid, ImprovCaptureStream writes the header with the first record
+  if (length == 0)
+    return;
+
+  if (length < sizeof(header) || memcmp(data, header, sizeof(header)) != 0)
+  {
+    error = true;
+    this->length = 0;
+    return;
+  }
+  position = sizeof(header);
+}
+
+bool ImprovCaptureReader::next(Record &record)
+{
+  if (position >= length)
+    return false;
+
+  uint8_t tag = data[position++];
+  uint64_t delta, size;
+  if ((tag != ImprovCaptureStream::CAPTURE_IN && tag != ImprovCaptureStream::CAPTURE_OUT) || !readVarint(delta) ||
+      !readVarint(size) || size == 0 || size > length - position)
+  {
+    error = true;
+    position = length;
+    return false;
+  }
+
+  time += delta;
+  record.direction = (ImprovCaptureStream::Direction)tag;
+  record.time = time;
+  record.data = &data[position];
+  record.length = size;
+  position += size;
+  return true;
+}
+
+bool ImprovCaptureReader::readVarint(uint64_t &value)
+{
+  value = 0;
+  for (uint8_t shift = 0; shift < 64 && position < length; shift += 7)
+  {
+    uint8_t byte = data[position++];
+    value |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
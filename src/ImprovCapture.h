@@ -0,0 +1,116 @@
+#pragma once
+
+#include <Stream.h>
+#include "ImprovClock.h"
+
+#ifndef IMPROV_CAPTURE_CHUNK
+#define IMPROV_CAPTURE_CHUNK 64
+#endif
+
+static_assert(IMPROV_CAPTURE_CHUNK > 0 && IMPROV_CAPTURE_CHUNK <= 255, "IMPROV_CAPTURE_CHUNK must be between 1 and 255");
+
+/**
+ * Improv capture stream
+ *
+ * @brief Records the traffic of an Improv session. Pass it to ImprovWiFi instead of the
+ *        serial port, every byte is forwarded and logged with its timestamp:
+ *
+ *   ImprovCaptureStream capture(&Serial, &logFile);
+ *   ImprovWiFi improvSerial(&capture);
+ *
+ * The log starts with "IMPCAP" and a version byte (1), followed by records of
+ *   tag (0x00 bytes read by the device, 0x01 bytes written by it),
+ *   varint milliseconds since the previous record, varint length, bytes.
+ * Varints are little endian base 128. Consecutive bytes of the same direction and
+ * millisecond are merged into one record, call `flush()` before closing the log.
+ * `ImprovCaptureReader` reads the records back.
+ */
+class ImprovCaptureStream : public Stream
+{
+public:
+  enum Direction : uint8_t {
+    CAPTURE_IN = 0x00,
+    CAPTURE_OUT = 0x01,
+  };
+
+  /**
+   * @param     stream  stream carrying the Improv traffic, e.g. `Serial`
+   * @param     log  destination of the capture, e.g. a file
+   * @param     clock  time source of the timestamps, the system clock if `nullptr`
+   */
+  ImprovCaptureStream(Stream *stream, Print *log, ImprovClock *clock = nullptr);
+
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t write(uint8_t byte) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  void flush() override;
+
+  using Print::write;
+
+private:
+  Stream      *stream;
+  Print       *log;
+  ImprovClock *clock;
+
+  bool      headerWritten = false;
+  uint64_t  lastRecord    = 0;
+  uint64_t  chunkTime     = 0;
+  Direction chunkDirection = CAPTURE_IN;
+  uint8_t   chunk[IMPROV_CAPTURE_CHUNK];
+  uint8_t   chunkLength   = 0;
+
+  void record(Direction direction, const uint8_t *data, size_t size);
+  void flushChunk();
+  void writeVarint(uint64_t value);
+};
+
+/**
+ * Improv capture reader
+ *
+ * @brief Reads the records of a capture written by ImprovCaptureStream from memory:
+ *
+ *   ImprovCaptureReader reader(data, length);
+ *   ImprovCaptureReader::Record record;
+ *   while (reader.next(record))
+ *     ...
+ *
+ * The data has to outlive the reader, records point into it.
+ */
+class ImprovCaptureReader
+{
+public:
+  struct Record
+  {
+    ImprovCaptureStream::Direction direction;
+    uint64_t       time;     // milliseconds since the first record
+    const uint8_t *data;
+    size_t         length;
+  };
+
+  ImprovCaptureReader(const uint8_t *data, size_t length);
+
+  /**
+   * @brief     Read the next record.
+   *
+   * @return
+   *   - bool  false at the end of the capture, or if the header or a record is malformed (see `malformed()`)
+   */
+  bool next(Record &record);
+
+  /**
+   * @return
+   *   - bool  true if the capture ended with a malformed header or record
+   */
+  bool malformed() const { return error; }
+
+private:
+  const uint8_t *data;
+  size_t   length;
+  size_t   position = 0;
+  uint64_t time     = 0;
+  bool     error    = false;
+
+  bool readVarint(uint64_t &value);
+};
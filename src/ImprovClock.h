@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+
+#ifdef ARDUINO
+  #include <Arduino.h>
+#endif
+
+#if defined(ARDUINO_ARCH_ESP32)
+  #include <esp_timer.h>
+#endif
+
+/**
+ * Improv clock
+ *
+ * @brief Time source of ImprovWiFi. All timeouts and waits of the library go through it.
+ *
+ * @attention The time is 64-bit and monotonic, it does not wrap like `millis()` after 49 days.
+ *
+ */
+class ImprovClock
+{
+public:
+  virtual ~ImprovClock() {}
+
+  /**
+   * @brief     Milliseconds since an arbitrary but fixed start point.
+   */
+  virtual uint64_t millis64() = 0;
+
+  /**
+   * @brief     Wait for the given time, other tasks (WiFi stack, watchdog) must be able to run meanwhile.
+   */
+  virtual void sleep(uint32_t ms) = 0;
+};
+
+#ifdef ARDUINO
+/**
+ * @brief Default clock backed by the 64-bit system timer and `delay()`.
+ */
+class ImprovSystemClock : public ImprovClock
+{
+public:
+  uint64_t millis64() override {
+    #if defined(ARDUINO_ARCH_ESP8266)
+      return micros64() / 1000;
+    #else
+      return esp_timer_get_time() / 1000;
+    #endif
+  }
+
+  void sleep(uint32_t ms) override {
+    delay(ms);
+  }
+};
+#endif
+
+/**
+ * @brief Clock for simulations: time only moves forward on `sleep()` or `advance()`,
+ *        so long reconnect scenarios finish without waiting for real time.
+ */
+class ImprovVirtualClock : public ImprovClock
+{
+public:
+  uint64_t millis64() override {
+    return now;
+  }
+
+  void sleep(uint32_t ms) override {
+    now += ms;
+  }
+
+  void advance(uint64_t ms) {
+    now += ms;
+  }
+
+private:
+  uint64_t now = 0;
+};
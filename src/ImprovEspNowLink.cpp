@@ -0,0 +1,132 @@
+#include "ImprovEspNowLink.h"
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <cstring>
+
+#ifdef ESP32
+  #include <WiFi.h>
+  #include <esp_now.h>
+  #include <esp_wifi.h>
+  #include <esp_idf_version.h>
+#else
+  #include <ESP8266WiFi.h>
+  #include <espnow.h>
+  extern "C" {
+    #include <user_interface.h>
+  }
+#endif
+
+static uint8_t BROADCAST_ADDRESS[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+ImprovEspNowLink *ImprovEspNowLink::active = nullptr;
+
+ImprovEspNowLink::~ImprovEspNowLink() {
+  if (active == this) {
+    esp_now_deinit();
+    active = nullptr;
+  }
+}
+
+void ImprovEspNowLink::enqueue(const uint8_t *data, int length) {
+  ImprovEspNowLink *link = active;
+  if (link == nullptr || length <= 0 || (size_t)length > MAX_PACKET) {
+    return;
+  }
+
+  uint8_t head = link->head.load(std::memory_order_relaxed);
+  uint8_t next = (head + 1) % IMPROV_ESPNOW_QUEUE;
+  if (next == link->tail.load(std::memory_order_acquire)) {
+    return;
+  }
+  memcpy(link->queue[head].data, data, length);
+  link->queue[head].length = length;
+  link->head.store(next, std::memory_order_release);
+}
+
+#ifdef ESP32
+
+#if ESP_IDF_VERSION_MAJOR >= 5
+static void onEspNowReceive(const esp_now_recv_info_t *, const uint8_t *data, int length) {
+  ImprovEspNowLink::enqueue(data, length);
+}
+#else
+static void onEspNowReceive(const uint8_t *, const uint8_t *data, int length) {
+  ImprovEspNowLink::enqueue(data, length);
+}
+#endif
+
+bool ImprovEspNowLink::begin() {
+  if (esp_now_init() != ESP_OK) {
+    Serial.println(F("ESP-NOW init failed"));
+    return false;
+  }
+  active = this;
+  esp_now_register_recv_cb(onEspNowReceive);
+
+  if (!esp_now_is_peer_exist(BROADCAST_ADDRESS)) {
+    esp_now_peer_info_t peer = {};
+    memcpy(peer.peer_addr, BROADCAST_ADDRESS, sizeof(BROADCAST_ADDRESS));
+    peer.channel = 0;   // follow the station interface
+    peer.ifidx = WIFI_IF_STA;
+    peer.encrypt = false;
+    if (esp_now_add_peer(&peer) != ESP_OK) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ImprovEspNowLink::broadcast(const uint8_t *data, size_t length) {
+  return esp_now_send(BROADCAST_ADDRESS, data, length) == ESP_OK;
+}
+
+void ImprovEspNowLink::setChannel(uint8_t channel) {
+  esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+}
+
+#else
+
+static void onEspNowReceive(uint8_t *, uint8_t *data, uint8_t length) {
+  ImprovEspNowLink::enqueue(data, length);
+}
+
+bool ImprovEspNowLink::begin() {
+  if (esp_now_init() != 0) {
+    Serial.println(F("ESP-NOW init failed"));
+    return false;
+  }
+  active = this;
+  esp_now_set_self_role(ESP_NOW_ROLE_COMBO);
+  esp_now_register_recv_cb(onEspNowReceive);
+
+  if (!esp_now_is_peer_exist(BROADCAST_ADDRESS)) {
+    // channel 0: follow the station interface
+    return esp_now_add_peer(BROADCAST_ADDRESS, ESP_NOW_ROLE_COMBO, 0, nullptr, 0) == 0;
+  }
+  return true;
+}
+
+bool ImprovEspNowLink::broadcast(const uint8_t *data, size_t length) {
+  return esp_now_send(BROADCAST_ADDRESS, const_cast<uint8_t *>(data), length) == 0;
+}
+
+void ImprovEspNowLink::setChannel(uint8_t channel) {
+  wifi_set_channel(channel);
+}
+
+#endif
+
+bool ImprovEspNowLink::receive(uint8_t *data, size_t &length) {
+  uint8_t tail = this->tail.load(std::memory_order_relaxed);
+  if (tail == this->head.load(std::memory_order_acquire)) {
+    return false;
+  }
+  length = queue[tail].length;
+  memcpy(data, queue[tail].data, length);
+  this->tail.store((tail + 1) % IMPROV_ESPNOW_QUEUE, std::memory_order_release);
+  return true;
+}
+
+#endif
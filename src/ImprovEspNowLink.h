@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include "ImprovPeerLink.h"
+
+// received packets buffered between the ESP-NOW callback and loop()
+#ifndef IMPROV_ESPNOW_QUEUE
+#define IMPROV_ESPNOW_QUEUE 4
+#endif
+
+/**
+ * ESP-NOW peer link
+ *
+ * @brief Broadcasts over ESP-NOW on the current channel of the station interface.
+ *
+ * @attention Only one instance can be active, ESP-NOW has a single receive callback.
+ *            WiFi has to be started in station mode before `begin()`.
+ *
+ */
+class ImprovEspNowLink : public ImprovPeerLink
+{
+public:
+  ~ImprovEspNowLink();
+
+  bool begin() override;
+  bool broadcast(const uint8_t *data, size_t length) override;
+  bool receive(uint8_t *data, size_t &length) override;
+  void setChannel(uint8_t channel) override;
+
+  // called from the ESP-NOW receive callback
+  static void enqueue(const uint8_t *data, int length);
+
+private:
+  struct Packet {
+    uint8_t data[MAX_PACKET];
+    uint8_t length;
+  };
+
+  // single producer (WiFi task), single consumer (loop), a full queue drops new packets;
+  // each side publishes its index with release after touching the slot, the other one reads it with acquire
+  Packet               queue[IMPROV_ESPNOW_QUEUE];
+  std::atomic<uint8_t> head{0};
+  std::atomic<uint8_t> tail{0};
+
+  static ImprovEspNowLink *active;
+};
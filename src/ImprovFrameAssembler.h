@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "ImprovTypes.h"
+
+// Largest RPC payload accepted. The length byte allows up to 255, smaller values save RAM
+// on devices which only ever see short credentials.
+#ifndef IMPROV_MAX_PAYLOAD
+  #define IMPROV_MAX_PAYLOAD 255
+#endif
+
+static_assert(IMPROV_MAX_PAYLOAD > 0 && IMPROV_MAX_PAYLOAD <= 255, "IMPROV_MAX_PAYLOAD must be between 1 and 255");
+
+/**
+ * Improv frame assembler
+ *
+ * @brief Collects bytes of an Improv serial frame ("IMPROV", version, type, length, payload, checksum)
+ *        into a fixed buffer which is reused for every frame.
+ *
+ * @attention Frames announcing a payload larger than IMPROV_MAX_PAYLOAD are rejected as soon as
+ *            the length byte arrives, without consuming the rest of the frame.
+ */
+class ImprovFrameAssembler
+{
+public:
+  enum Result : uint8_t {
+    FRAME_INCOMPLETE,   // byte belongs to a frame, more are needed
+    FRAME_COMPLETE,     // byte completed a valid frame
+    FRAME_REJECTED,     // byte is not part of a frame
+    FRAME_BAD_CHECKSUM, // byte completed a frame with a wrong checksum
+  };
+
+  // header, payload, checksum
+  static const size_t CAPACITY = 9 + IMPROV_MAX_PAYLOAD + 1;
+
+  /**
+   * @brief     Feed the next byte of the stream.
+   *
+   * @return    the state of the frame after this byte
+   */
+  Result push(uint8_t byte)
+  {
+    if (position < 6)
+    {
+      if (byte != (uint8_t)"IMPROV"[position])
+        return restart(byte);
+    }
+    else if (position == 6)
+    {
+      if (byte != ImprovTypes::IMPROV_SERIAL_VERSION)
+        return restart(byte);
+    }
+#if IMPROV_MAX_PAYLOAD < 255
+    else if (position == 8)
+    {
+      if (byte > IMPROV_MAX_PAYLOAD)
+        return restart(byte);
+    }
+#endif
+    else if (position > 8 && position == 9 + (size_t)buffer[8])
+    {
+      buffer[position] = byte;
+      bool valid = checksum == byte;
+      reset();
+      return valid ? FRAME_COMPLETE : FRAME_BAD_CHECKSUM;
+    }
+
+    buffer[position++] = byte;
+    checksum += byte;
+    return FRAME_INCOMPLETE;
+  }
+
+  void reset()
+  {
+    position = 0;
+    checksum = 0;
+  }
+
+  // Accessors for the last complete frame, valid until the next frame starts.
+  uint8_t type() const { return buffer[7]; }
+  uint8_t payloadLength() const { return buffer[8]; }
+  const uint8_t *payload() const { return &buffer[9]; }
+
+private:
+  uint8_t buffer[CAPACITY];
+  size_t  position = 0;
+  uint8_t checksum = 0;
+
+  // drop the current frame, the rejected byte may already start the next one
+  Result restart(uint8_t byte)
+  {
+    reset();
+    if (byte == 'I')
+    {
+      buffer[position++] = byte;
+      checksum = byte;
+      return FRAME_INCOMPLETE;
+    }
+    return FRAME_REJECTED;
+  }
+};
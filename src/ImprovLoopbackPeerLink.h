@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include "ImprovPeerLink.h"
+
+class ImprovLoopbackPeerLink;
+
+/**
+ * @brief Medium of ImprovLoopbackPeerLink: every packet broadcast by one link is delivered to all others.
+ */
+class ImprovLoopbackBus
+{
+public:
+  uint32_t packets = 0;   // broadcasts sent over the bus
+
+private:
+  friend class ImprovLoopbackPeerLink;
+  std::vector<ImprovLoopbackPeerLink *> links;
+};
+
+/**
+ * @brief In-process stand-in for a radio link, e.g. to simulate a fleet of devices in one program.
+ */
+class ImprovLoopbackPeerLink : public ImprovPeerLink
+{
+public:
+  explicit ImprovLoopbackPeerLink(ImprovLoopbackBus &bus) : bus(bus)
+  {
+    bus.links.push_back(this);
+  }
+
+  ~ImprovLoopbackPeerLink()
+  {
+    for (auto it = bus.links.begin(); it != bus.links.end(); ++it)
+    {
+      if (*it == this)
+      {
+        bus.links.erase(it);
+        break;
+      }
+    }
+  }
+
+  bool begin() override
+  {
+    return true;
+  }
+
+  bool broadcast(const uint8_t *data, size_t length) override
+  {
+    if (length > MAX_PACKET)
+      return false;
+
+    bus.packets++;
+    for (ImprovLoopbackPeerLink *link : bus.links)
+    {
+      if (link != this)
+        link->inbox.emplace_back(data, data + length);
+    }
+    return true;
+  }
+
+  bool receive(uint8_t *data, size_t &length) override
+  {
+    if (inbox.empty())
+      return false;
+
+    length = inbox.front().size();
+    std::copy(inbox.front().begin(), inbox.front().end(), data);
+    inbox.pop_front();
+    return true;
+  }
+
+private:
+  ImprovLoopbackBus &bus;
+  std::deque<std::vector<uint8_t>> inbox;
+};
@@ -0,0 +1,134 @@
+#include "ImprovPeerEnvelope.h"
+
+#include <cstring>
+
+#ifdef ESP32
+  #include <mbedtls/md.h>
+#else
+  #include <bearssl/bearssl_hmac.h>
+#endif
+
+static const uint8_t ENVELOPE_MAGIC[4] = {'I', 'M', 'P', 'P'};
+static const uint8_t ENVELOPE_VERSION = 1;
+
+void ImprovPeerEnvelope::hmac(const uint8_t *key, size_t keyLength, const uint8_t *data, size_t length,
+                              const uint8_t *data2, size_t length2, uint8_t out[32]) {
+#ifdef ESP32
+  mbedtls_md_context_t ctx;
+  mbedtls_md_init(&ctx);
+  mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1);
+  mbedtls_md_hmac_starts(&ctx, key, keyLength);
+  mbedtls_md_hmac_update(&ctx, data, length);
+  if (length2 > 0) {
+    mbedtls_md_hmac_update(&ctx, data2, length2);
+  }
+  mbedtls_md_hmac_finish(&ctx, out);
+  mbedtls_md_free(&ctx);
+#else
+  br_hmac_key_context keyContext;
+  br_hmac_context ctx;
+  br_hmac_key_init(&keyContext, &br_sha256_vtable, key, keyLength);
+  br_hmac_init(&ctx, &keyContext, 0);
+  br_hmac_update(&ctx, data, length);
+  if (length2 > 0) {
+    br_hmac_update(&ctx, data2, length2);
+  }
+  br_hmac_out(&ctx, out);
+#endif
+}
+
+bool ImprovPeerEnvelope::setKey(const uint8_t *key, size_t length) {
+  if (length < 16) {
+    return false;
+  }
+  hmac(key, length, (const uint8_t *)"improv-peer-enc", 15, nullptr, 0, encryptionKey);
+  hmac(key, length, (const uint8_t *)"improv-peer-auth", 16, nullptr, 0, authenticationKey);
+  hasKey = true;
+  return true;
+}
+
+// XOR with HMAC(encryptionKey, header || block counter)
+void ImprovPeerEnvelope::crypt(const uint8_t *header, uint8_t *data, size_t length) {
+  uint8_t block[32];
+  for (size_t offset = 0; offset < length; offset += sizeof(block)) {
+    uint8_t counter = offset / sizeof(block);
+    hmac(encryptionKey, sizeof(encryptionKey), header, HEADER_LENGTH, &counter, 1, block);
+    for (size_t i = 0; i < sizeof(block) && offset + i < length; i++) {
+      data[offset + i] ^= block[i];
+    }
+  }
+  memset(block, 0, sizeof(block));
+}
+
+size_t ImprovPeerEnvelope::seal(const uint8_t sender[6], uint32_t messageId, const char *ssid, const char *password, uint8_t *out) {
+  size_t ssidLength = strlen(ssid);
+  size_t passwordLength = strlen(password);
+  if (!hasKey || ssidLength == 0 || ssidLength > 32 || passwordLength > 64) {
+    return 0;
+  }
+
+  size_t bodyLength = 2 + ssidLength + passwordLength;
+
+  memcpy(out, ENVELOPE_MAGIC, 4);
+  out[4] = ENVELOPE_VERSION;
+  memcpy(&out[5], sender, 6);
+  out[11] = messageId >> 24;
+  out[12] = messageId >> 16;
+  out[13] = messageId >> 8;
+  out[14] = messageId;
+  out[15] = bodyLength;
+
+  uint8_t *body = &out[HEADER_LENGTH];
+  body[0] = ssidLength;
+  memcpy(&body[1], ssid, ssidLength);
+  body[1 + ssidLength] = passwordLength;
+  memcpy(&body[2 + ssidLength], password, passwordLength);
+  crypt(out, body, bodyLength);
+
+  uint8_t tag[32];
+  hmac(authenticationKey, sizeof(authenticationKey), out, HEADER_LENGTH + bodyLength, nullptr, 0, tag);
+  memcpy(&body[bodyLength], tag, TAG_LENGTH);
+
+  return HEADER_LENGTH + bodyLength + TAG_LENGTH;
+}
+
+bool ImprovPeerEnvelope::open(const uint8_t *in, size_t length, uint8_t sender[6], uint32_t &messageId, char ssid[33], char password[65]) {
+  if (!hasKey || length < HEADER_LENGTH + 2 + TAG_LENGTH || length > MAX_LENGTH ||
+      memcmp(in, ENVELOPE_MAGIC, 4) != 0 || in[4] != ENVELOPE_VERSION ||
+      (size_t)in[15] + HEADER_LENGTH + TAG_LENGTH != length) {
+    return false;
+  }
+  size_t bodyLength = in[15];
+
+  // constant time, a mismatch must not tell how many bytes were right
+  uint8_t tag[32];
+  hmac(authenticationKey, sizeof(authenticationKey), in, HEADER_LENGTH + bodyLength, nullptr, 0, tag);
+  uint8_t diff = 0;
+  for (size_t i = 0; i < TAG_LENGTH; i++) {
+    diff |= tag[i] ^ in[HEADER_LENGTH + bodyLength + i];
+  }
+  if (diff != 0) {
+    return false;
+  }
+
+  uint8_t body[MAX_LENGTH];
+  memcpy(body, &in[HEADER_LENGTH], bodyLength);
+  crypt(in, body, bodyLength);
+
+  bool valid = false;
+  size_t ssidLength = body[0];
+  if (ssidLength > 0 && ssidLength <= 32 && 1 + ssidLength < bodyLength) {
+    size_t passwordLength = body[1 + ssidLength];
+    if (passwordLength <= 64 && 2 + ssidLength + passwordLength == bodyLength) {
+      memcpy(ssid, &body[1], ssidLength);
+      ssid[ssidLength] = '\0';
+      memcpy(password, &body[2 + ssidLength], passwordLength);
+      password[passwordLength] = '\0';
+      memcpy(sender, &in[5], 6);
+      messageId = (uint32_t)in[11] << 24 | (uint32_t)in[12] << 16 | (uint32_t)in[13] << 8 | in[14];
+      valid = true;
+    }
+  }
+  memset(body, 0, sizeof(body));
+  return valid;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Improv peer envelope
+ *
+ * @brief Seals WiFi credentials for an ImprovPeerLink with a key shared by the fleet.
+ *        Layout: "IMPP", version, sender MAC (6), message id (4), length, encrypted credentials, tag (16).
+ *
+ * @attention The credentials are encrypted with an HMAC-SHA256 keystream over the header and authenticated
+ *            with a truncated HMAC-SHA256 over header and ciphertext. Both keys are derived from the fleet key.
+ *            The header is the nonce, so a sender must not reuse a message id for different credentials.
+ *
+ */
+class ImprovPeerEnvelope
+{
+public:
+  static const size_t HEADER_LENGTH = 16;
+  static const size_t TAG_LENGTH = 16;
+  // ssid and password, each with a length byte
+  static const size_t MAX_LENGTH = HEADER_LENGTH + 1 + 32 + 1 + 64 + TAG_LENGTH;
+
+  /**
+   * @brief     Derive the encryption and authentication keys from the fleet key.
+   *
+   * @return    false if the key is shorter than 16 bytes
+   */
+  bool setKey(const uint8_t *key, size_t length);
+
+  /**
+   * @brief     Build an envelope into `out`, which has room for MAX_LENGTH bytes.
+   *
+   * @return    length of the envelope, 0 if the credentials are too long
+   */
+  size_t seal(const uint8_t sender[6], uint32_t messageId, const char *ssid, const char *password, uint8_t *out);
+
+  /**
+   * @brief     Check and decrypt an envelope, the strings are NUL-terminated.
+   *
+   * @return    false if it is malformed or was not sealed with the same key
+   */
+  bool open(const uint8_t *in, size_t length, uint8_t sender[6], uint32_t &messageId, char ssid[33], char password[65]);
+
+private:
+  uint8_t encryptionKey[32];
+  uint8_t authenticationKey[32];
+  bool    hasKey = false;
+
+  static void hmac(const uint8_t *key, size_t keyLength, const uint8_t *data, size_t length,
+                   const uint8_t *data2, size_t length2, uint8_t out[32]);
+  void crypt(const uint8_t *header, uint8_t *data, size_t length);
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Improv peer link
+ *
+ * @brief Broadcast transport between devices, used to hand WiFi credentials to unprovisioned peers.
+ *        ImprovPeerProvisioning polls it from `loop()`, so `receive()` never runs in a callback context.
+ *
+ * @attention Packets are unreliable and unauthenticated, ImprovPeerProvisioning seals them itself.
+ *
+ */
+class ImprovPeerLink
+{
+public:
+  // largest packet, the payload limit of ESP-NOW
+  static const size_t MAX_PACKET = 250;
+
+  virtual ~ImprovPeerLink() {}
+
+  virtual bool begin() = 0;
+
+  /**
+   * @brief     Send a packet to all peers in range.
+   */
+  virtual bool broadcast(const uint8_t *data, size_t length) = 0;
+
+  /**
+   * @brief     Take the next received packet, `data` has room for MAX_PACKET bytes.
+   *
+   * @return    false if none is waiting
+   */
+  virtual bool receive(uint8_t *data, size_t &length) = 0;
+
+  /**
+   * @brief     Listen on another radio channel, called while an unprovisioned device searches for a sender.
+   */
+  virtual void setChannel(uint8_t /* channel */) {}
+};
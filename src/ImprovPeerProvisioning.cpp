@@ -0,0 +1,152 @@
+#include "ImprovPeerProvisioning.h"
+#include "ImprovWiFiLibrary.h"
+
+#include <algorithm>
+#include <cstring>
+
+static ImprovSystemClock systemClock;
+
+ImprovPeerProvisioning::ImprovPeerProvisioning(ImprovWiFi &improv, ImprovClock *clock):
+  improv(improv),
+  clock(clock ? clock : &systemClock)
+{
+
+}
+
+bool ImprovPeerProvisioning::begin(ImprovPeerLink *link, const uint8_t *key, size_t keyLength, bool relay) {
+  if (!envelope.setKey(key, keyLength) || !link->begin()) {
+    return false;
+  }
+
+  if (!this->link) {
+    // remember the credentials of every connection, share the ones just provisioned
+    improv.onImprovConnected([this](const char *ssid, const char *password) {
+      this->ssid = ssid;
+      this->password = password;
+    });
+    improv.onImprovProvisioned([this](const char *ssid, const char *password) {
+      if (!this->receiving || this->relay) {
+        this->offer(ssid, password);
+      }
+    });
+  }
+  this->link = link;
+  this->relay = relay;
+
+  // the message id is part of the nonce, it must not start over after a reboot
+  #ifdef ESP32
+    this->messageId = esp_random();
+  #else
+    this->messageId = ESP.random();
+  #endif
+  return true;
+}
+
+bool ImprovPeerProvisioning::share() {
+  if (!this->link || this->ssid.empty()) {
+    return false;
+  }
+  return this->offer(this->ssid.c_str(), this->password.c_str());
+}
+
+bool ImprovPeerProvisioning::offer(const char *ssid, const char *password) {
+  uint8_t mac[6];
+  uint8_t sealed[ImprovPeerEnvelope::MAX_LENGTH];
+  WiFi.macAddress(mac);
+
+  size_t length = envelope.seal(mac, ++this->messageId, ssid, password, sealed);
+  if (length == 0) {
+    return false;
+  }
+  this->frame.assign(sealed, sealed + length);
+  memset(sealed, 0, sizeof(sealed));
+
+  this->shareUntil = clock->millis64() + IMPROV_PEER_SHARE_MS;
+  this->millisShare = 0;
+  return true;
+}
+
+void ImprovPeerProvisioning::forget() {
+  std::fill(this->frame.begin(), this->frame.end(), 0);
+  this->frame.clear();
+}
+
+void ImprovPeerProvisioning::loop() {
+  if (!this->link) {
+    return;
+  }
+
+  uint64_t now = clock->millis64();
+  uint8_t packet[ImprovPeerLink::MAX_PACKET];
+  size_t length;
+  // credentials saved by a custom callback are only visible as a connection
+  bool provisioned = improv.hasCredentials() || improv.isConnected();
+
+  while (this->link->receive(packet, length)) {
+    // provisioned devices only send
+    if (provisioned) {
+      continue;
+    }
+    // the HMAC is the expensive part, limit how often it runs
+    if (now - this->millisWindow >= 1000) {
+      this->millisWindow = now;
+      this->windowCount = 0;
+    }
+    if (this->windowCount >= IMPROV_PEER_RATE_LIMIT) {
+      continue;
+    }
+    this->windowCount++;
+    this->handleEnvelope(packet, length);
+    provisioned = improv.hasCredentials() || improv.isConnected();
+  }
+
+  if (!provisioned) {
+    // senders stay on the channel of their AP, so the listener has to find it
+    if (now - this->millisHop >= IMPROV_PEER_DWELL_MS) {
+      this->millisHop = now;
+      this->channel = this->channel % 13 + 1;
+      this->link->setChannel(this->channel);
+    }
+    return;
+  }
+
+  if (this->frame.empty()) {
+    return;
+  }
+  if (now >= this->shareUntil) {
+    this->forget();
+    return;
+  }
+  if (improv.isConnected() && now - this->millisShare >= IMPROV_PEER_INTERVAL_MS) {
+    this->millisShare = now;
+    this->link->broadcast(this->frame.data(), this->frame.size());
+  }
+}
+
+void ImprovPeerProvisioning::handleEnvelope(const uint8_t *data, size_t length) {
+  PeerMessage message;
+  char ssid[33];
+  char password[65];
+
+  if (!envelope.open(data, length, message.sender, message.id, ssid, password)) {
+    return;
+  }
+
+  // only after the tag was checked, forged envelopes must not push real ones out
+  for (const PeerMessage &known : this->seen) {
+    if (known.id == message.id && memcmp(known.sender, message.sender, sizeof(message.sender)) == 0) {
+      memset(password, 0, sizeof(password));
+      return;
+    }
+  }
+  this->seen[this->seenNext] = message;
+  this->seenNext = (this->seenNext + 1) % IMPROV_PEER_DEDUP;
+
+  Serial.printf("WiFi credentials received from peer %02X:%02X:%02X:%02X:%02X:%02X\n",
+    message.sender[0], message.sender[1], message.sender[2], message.sender[3], message.sender[4], message.sender[5]);
+
+  this->receiving = true;
+  improv.provision(ssid, password);
+  this->receiving = false;
+  memset(password, 0, sizeof(password));
+}
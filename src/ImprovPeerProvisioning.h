@@ -0,0 +1,123 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "ImprovClock.h"
+#include "ImprovPeerEnvelope.h"
+#include "ImprovPeerLink.h"
+
+// interval of the credential broadcasts to unprovisioned peers
+#ifndef IMPROV_PEER_INTERVAL_MS
+#define IMPROV_PEER_INTERVAL_MS 250
+#endif
+
+// time the credentials are offered to peers after provisioning
+#ifndef IMPROV_PEER_SHARE_MS
+#define IMPROV_PEER_SHARE_MS 300000
+#endif
+
+// time an unprovisioned device listens on one channel for a sharing peer
+#ifndef IMPROV_PEER_DWELL_MS
+#define IMPROV_PEER_DWELL_MS 600
+#endif
+
+// peer envelopes checked per second, further ones are dropped unread
+#ifndef IMPROV_PEER_RATE_LIMIT
+#define IMPROV_PEER_RATE_LIMIT 8
+#endif
+
+// peer messages remembered to drop repeated envelopes
+#ifndef IMPROV_PEER_DEDUP
+#define IMPROV_PEER_DEDUP 8
+#endif
+
+class ImprovWiFi;
+
+/**
+ * Improv peer provisioning
+ *
+ * @brief Hands the WiFi credentials of an ImprovWiFi to unprovisioned devices over a peer link, e.g.
+ *        `ImprovEspNowLink`. Optional, only sketches using it link the envelope and its HMAC:
+ *
+ *   ImprovWiFi improvSerial(&Serial);
+ *   ImprovEspNowLink peerLink;
+ *   ImprovPeerProvisioning peers(improvSerial);
+ *
+ *   peers.begin(&peerLink, FLEET_KEY, sizeof(FLEET_KEY));   // in setup()
+ *   peers.loop();                                          // in loop(), next to improvSerial.loop()
+ *
+ * After provisioning over serial, the device broadcasts its credentials every `IMPROV_PEER_INTERVAL_MS`
+ * (default 250) for `IMPROV_PEER_SHARE_MS` (default 300000) while it is connected. A device without credentials
+ * listens instead, hopping through the channels every `IMPROV_PEER_DWELL_MS` (default 600). Received credentials
+ * go through `ImprovWiFi::provision()`; with `relay` the device then shares them too, so the credentials spread
+ * through the fleet.
+ *
+ * @attention Envelopes are encrypted and authenticated with the fleet key, which all devices have to share.
+ *            At most `IMPROV_PEER_RATE_LIMIT` envelopes per second are checked and repeated ones are ignored.
+ *            `begin()` registers callbacks with the ImprovWiFi, this instance has to live as long as it.
+ *
+ */
+class ImprovPeerProvisioning
+{
+public:
+  /**
+   * @param     improv  instance whose credentials are shared
+   * @param     clock  time source, the system clock if `nullptr`
+   */
+  ImprovPeerProvisioning(ImprovWiFi &improv, ImprovClock *clock = nullptr);
+
+  /**
+   * @brief     Start listening or sharing.
+   *
+   * @param     link  transport to the peers, has to outlive this instance
+   * @param     key  fleet key, at least 16 bytes
+   * @param     keyLength  length of the key
+   * @param     relay  offer credentials received from a peer as well
+   *
+   * @return
+   *   - bool  false if the key is too short or the link could not be started
+   */
+  bool begin(ImprovPeerLink *link, const uint8_t *key, size_t keyLength, bool relay = true);
+
+  /**
+   * @brief     Offer the current credentials to peers for another `IMPROV_PEER_SHARE_MS`, e.g. on a button press.
+   *
+   * @return
+   *   - bool  false if `begin()` was not called or no connection was made yet
+   */
+  bool share();
+
+  /**
+   * @brief     Receive and send envelopes, call it from the sketch loop.
+   */
+  void loop();
+
+private:
+  struct PeerMessage {
+    uint8_t  sender[6];
+    uint32_t id;
+  };
+
+  ImprovWiFi         &improv;
+  ImprovClock        *clock;
+  ImprovPeerLink     *link = nullptr;
+  ImprovPeerEnvelope  envelope;
+  std::vector<uint8_t> frame;             // sealed envelope currently offered
+  std::string ssid;                       // credentials of the last connection
+  std::string password;
+  bool      relay               = false;  // offer credentials received from a peer as well
+  bool      receiving           = false;  // provisioning from a received envelope
+  uint32_t  messageId           = 0;
+  uint64_t  shareUntil          = 0;
+  uint64_t  millisShare         = 0;
+  uint8_t   channel             = 1;
+  uint64_t  millisHop           = 0;
+  uint64_t  millisWindow        = 0;
+  uint8_t   windowCount         = 0;
+  PeerMessage seen[IMPROV_PEER_DEDUP] = {};
+  uint8_t   seenNext            = 0;
+
+  void handleEnvelope(const uint8_t *data, size_t length);
+  bool offer(const char *ssid, const char *password);
+  void forget();
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include "ImprovTypes.h"
+
+/**
+ * Improv response encoder
+ *
+ * @brief Builds an RPC response frame (command, data length, length-prefixed strings) in a fixed
+ *        buffer on the stack of the dispatch, so handlers do not allocate.
+ *
+ * @attention The payload of a frame is limited to 255 bytes. Strings which do not fit anymore are
+ *            rejected and the response is marked as overflowed; ERROR_UNKNOWN is sent instead.
+ */
+class ImprovResponseEncoder
+{
+public:
+  // header, command, data length, data, checksum
+  static const size_t CAPACITY = 9 + 255 + 1;
+
+  /**
+   * @brief     Start the response to `command`, drops everything added before.
+   */
+  void begin(uint8_t command)
+  {
+    buffer[9] = command;
+    length = 11;
+    strings = 0;
+    overflow = false;
+    skipped = false;
+    errorCode = ImprovTypes::ERROR_NONE;
+  }
+
+  /**
+   * @brief     Append a length-prefixed string, the bytes do not have to be printable.
+   *
+   * @return    false if it does not fit into the frame
+   */
+  bool add(const char *data, size_t size)
+  {
+    if (overflow || length + 1 + size > 9 + 255)
+    {
+      overflow = true;
+      return false;
+    }
+    buffer[length++] = (uint8_t)size;
+    memcpy(&buffer[length], data, size);
+    length += size;
+    strings++;
+    return true;
+  }
+
+  bool add(const char *str) { return add(str, strlen(str)); }
+  bool add(const std::string &str) { return add(str.data(), str.size()); }
+
+  /**
+   * @brief     Answer with an error state instead of the response.
+   *
+   * @return    false, so a handler can `return response.fail(...)`
+   */
+  bool fail(ImprovTypes::Error error)
+  {
+    errorCode = error;
+    return false;
+  }
+
+  /**
+   * @brief     Send nothing after the handler returned, e.g. because it answered on its own.
+   */
+  void skip()
+  {
+    skipped = true;
+  }
+
+  ImprovTypes::Error error() const { return errorCode; }
+  bool overflowed() const { return overflow; }
+  bool isSkipped() const { return skipped; }
+  bool empty() const { return strings == 0; }
+
+  /**
+   * @brief     Fill in header, lengths and checksum.
+   *
+   * @return    the complete frame, `size` bytes long
+   */
+  const uint8_t *finish(size_t &size)
+  {
+    memcpy(buffer, "IMPROV", 6);
+    buffer[6] = ImprovTypes::IMPROV_SERIAL_VERSION;
+    buffer[7] = ImprovTypes::TYPE_RPC_RESPONSE;
+    buffer[8] = (uint8_t)(length - 9);
+    buffer[10] = (uint8_t)(length - 11);
+
+    uint8_t checksum = 0;
+    for (size_t i = 0; i < length; i++)
+      checksum += buffer[i];
+    buffer[length] = checksum;
+
+    size = length + 1;
+    return buffer;
+  }
+
+private:
+  uint8_t buffer[CAPACITY];
+  size_t  length = 11;
+  uint8_t strings = 0;
+  bool    overflow = false;
+  bool    skipped = false;
+  ImprovTypes::Error errorCode = ImprovTypes::ERROR_NONE;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "ImprovTypes.h"
+
+/**
+ * Improv RPC decoder
+ *
+ * @brief Decodes the payload of an RPC frame (command, data length, data) in a single pass
+ *        without copying. The resulting view points into the frame buffer.
+ *
+ * @attention Every length is checked against the payload length. The frame is not modified, so the
+ *            strings of WIFI_SETTINGS are not NUL-terminated: use the lengths of the view.
+ */
+class ImprovRpcDecoder
+{
+public:
+  /**
+   * @brief     Decode `length` bytes of RPC payload into `command`.
+   *
+   * @return    false if the frame is malformed
+   */
+  static bool decode(const uint8_t *data, size_t length, ImprovTypes::ImprovCommandView &command)
+  {
+    command = {};
+
+    if (length < 2)
+      return false;
+
+    command.command = (ImprovTypes::Command)data[0];
+    uint8_t data_length = data[1];
+
+    if ((size_t)data_length + 2 != length)
+      return false;
+
+    command.data = data + 2;
+    command.dataLength = data_length;
+
+    if (command.command == ImprovTypes::Command::WIFI_SETTINGS)
+    {
+      if (length < 3)
+        return false;
+
+      uint8_t ssid_length = data[2];
+      size_t ssid_start = 3;
+      size_t ssid_end = ssid_start + ssid_length;
+
+      if (ssid_end >= length)
+        return false;
+
+      uint8_t pass_length = data[ssid_end];
+      size_t pass_start = ssid_end + 1;
+      size_t pass_end = pass_start + pass_length;
+
+      if (pass_end > length)
+        return false;
+
+      command.ssid = (const char *)&data[ssid_start];
+      command.ssidLength = ssid_length;
+      command.password = (const char *)&data[pass_start];
+      command.passwordLength = pass_length;
+    }
+
+    return true;
+  }
+};
@@ -31,6 +31,7 @@ enum Error : uint8_t {
   ERROR_NOT_AUTHORIZED = 0x04,
   ERROR_WIFI_DISCONNECTED = 0x05,   // suddenly disconnected
   ERROR_WIFI_CONNECT_GIVEUP = 0x06, // after MAX_ATTEMPTS_WIFI_CONNECTION
+  ERROR_CREDENTIALS_NOT_SAVED = 0x07, // write-behind save failed after STATE_PROVISIONED was sent
   ERROR_UNKNOWN = 0xFF,
 };
 
@@ -45,14 +46,35 @@ enum State : uint8_t {
 enum Command : uint8_t {
   UNKNOWN = 0x00,
   WIFI_SETTINGS = 0x01,
-  IDENTIFY = 0x02,
+  IDENTIFY = 0x02,           // BLE only, over serial 0x02 is GET_CURRENT_STATE
   GET_CURRENT_STATE = 0x02,
   GET_DEVICE_INFO = 0x03,
   GET_WIFI_NETWORKS = 0x04,
+  // vendor extensions, ignored by standard clients
+  SET_BAUD_RATE = 0xF0,
   BAD_CHECKSUM = 0xFF,
 };
 
 static const uint8_t CAPABILITY_IDENTIFY = 0x01;
+
+// Optional payload of GET_WIFI_NETWORKS requesting the compact list: networks are packed into as
+// few responses as possible, each record is
+//   ssid length, ssid, rssi (int8), channel, auth (NetworkAuth), bssid (6 bytes)
+// followed by the usual empty response marking the end of the list.
+static const uint8_t NETWORK_LIST_COMPACT = 0x01;
+
+// Authentication of a network in the compact list, the same on every platform
+enum NetworkAuth : uint8_t {
+  AUTH_OPEN = 0x00,
+  AUTH_WEP = 0x01,
+  AUTH_WPA_PSK = 0x02,
+  AUTH_WPA2_PSK = 0x03,
+  AUTH_WPA_WPA2_PSK = 0x04,       // also ESP8266 "auto", which does not tell WPA from WPA2
+  AUTH_WPA2_ENTERPRISE = 0x05,
+  AUTH_WPA3_PSK = 0x06,
+  AUTH_WPA2_WPA3_PSK = 0x07,
+  AUTH_OTHER = 0xFF,              // any other mode the platform reports
+};
 static const uint8_t IMPROV_SERIAL_VERSION = 1;
 
 enum ImprovSerialType : uint8_t {
@@ -68,6 +90,60 @@ struct ImprovCommand {
   std::string password;
 };
 
+// Non-owning view of a decoded RPC, all pointers refer into the frame buffer
+// and are only valid while the command is being handled.
+struct ImprovCommandView {
+  Command command;
+  const uint8_t *data;      // RPC payload behind the command and length byte
+  uint8_t dataLength;
+  const char *ssid;         // WIFI_SETTINGS only, not NUL-terminated
+  uint8_t ssidLength;
+  const char *password;     // WIFI_SETTINGS only, not NUL-terminated
+  uint8_t passwordLength;
+};
+
+// access point found by a targeted scan
+struct NetworkInfo {
+  int8_t rssi;
+  uint8_t channel;
+  uint8_t bssid[6];
+  bool open;
+  uint16_t channels;    // every channel the network was seen on, bit n for channel n
+};
+
+// last DHCP lease, persisted next to the credentials
+struct DhcpLease {
+  uint8_t version;      // LEASE_VERSION if valid
+  uint8_t bssid[6];     // AP the lease was obtained from
+  uint8_t channel;      // channel of that AP, the first reconnect after a boot goes there without a scan
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns1;
+  uint32_t dns2;
+  uint32_t leaseSeconds; // lease time granted by the DHCP server, 0 if unknown
+};
+
+static const uint8_t LEASE_VERSION = 3;
+
+// WiFi credentials as persisted by the library, written alternately to two slots
+struct CredentialRecord {
+  uint32_t magic;       // CREDENTIAL_MAGIC if the slot was ever written
+  uint32_t sequence;    // incremented on every save, the valid record with the highest one is current
+  char ssid[33];
+  char password[65];
+  uint32_t crc;         // CRC-32 of all bytes before it
+};
+
+static const uint32_t CREDENTIAL_MAGIC = 0x43504D49; // "IMPC"
+
+enum PersistStatus : uint8_t {
+  PERSIST_IDLE = 0x00,      // nothing saved yet
+  PERSIST_PENDING = 0x01,   // accepted, written by the next loop()
+  PERSIST_DONE = 0x02,
+  PERSIST_FAILED = 0x03,
+};
+
 enum ChipFamily : uint8_t {
   CF_ESP32,
   CF_ESP32_C3,
@@ -1,31 +1,46 @@
 #include "ImprovWiFiLibrary.h"
 
+#include <lwip/dhcp.h>
+#include <lwip/etharp.h>
+#include <lwip/netif.h>
+#if defined(ARDUINO_ARCH_ESP32)
+  #include <lwip/tcpip.h>
+#endif
+
+static ImprovSystemClock systemClock;
+
 ImprovWiFi::ImprovWiFi(Stream *serial):
-  _stopme(millis() + IMPROV_RUN_FOR),
+  clock(&systemClock),
+  _stopme(systemClock.millis64() + IMPROV_RUN_FOR),
   serial(serial),
   connectFailure(false),
-  maxConnectRetries(30),
+  maxConnectRetries(IMPROV_MAX_CONNECT_RETRIES),
   numConnectRetriesDone(0),
   millisLastConnectTry(0),
   lastConnectStatus(false)
 {
-    
+  registerBuiltinRpcHandlers();
 }
 
 void ImprovWiFi::checkSerial() {
-  while (Serial.available() > 0) {
-    uint8_t b = serial->read();
+  uint8_t chunk[64];
+  int available;
 
-    if (parseImprovSerial(this->_position, b, this->_buffer)) {
-      this->_buffer[this->_position++] = b;
-    } else {
-      this->_position = 0;
+  while ((available = serial->available()) > 0) {
+    size_t length = serial->readBytes(chunk, std::min<size_t>(available, sizeof(chunk)));
+    if (length == 0) {
+      break;
     }
+    this->handleBytes(chunk, length);
   }
+
+  // also polled from the blocking waits, which call checkSerial() but not loop()
+  this->checkBaudRateTimeout();
 }
 
 void ImprovWiFi::loop() {
   this->checkSerial();
+  this->checkPersistence();
 
   bool isConnected = this->isConnected();
 
@@ -41,6 +56,20 @@ void ImprovWiFi::loop() {
       }
 
       this->numConnectRetriesDone = 0;
+      this->rssiSamples = 0;
+      this->roaming = false;
+      this->knownChannels |= channelBit(WiFi.channel());
+
+      if (this->leaseApplied) {
+        // probe the cached lease a bit later
+        this->leaseCheck = LEASE_CHECK_WAIT;
+        this->millisLeaseValidate = clock->millis64();
+        this->millisLeaseApplied = this->millisLeaseValidate;
+      } else {
+        this->storeCurrentLease();
+      }
+    } else if (this->roaming) {
+      Serial.println(F("Roaming to a stronger AP..."));
     } else {
       Serial.println(F("WiFi connection lost."));
       
@@ -54,6 +83,24 @@ void ImprovWiFi::loop() {
     
     this->lastConnectStatus = isConnected;
   }
+
+  if (this->roaming && clock->millis64() - this->millisLastRoam >= IMPROV_CONNECT_TIMEOUT_MS) {
+    // from now on a lost connection is reported and handled as usual
+    this->roaming = false;
+  }
+
+  if (isConnected) {
+    this->checkLeaseStore();
+    this->checkLease();
+    this->checkLinkQuality();
+  } else {
+    this->finishRoamScan();
+  }
+
+  if (!isConnected && this->roaming) {
+    // give the re-association time before the regular reconnect takes over
+    return;
+  }
   
   if(!isConnected && this->WifiCredentialsAvailable) {
 
@@ -75,22 +122,88 @@ void ImprovWiFi::loop() {
 }
 
 bool ImprovWiFi::handleBuffer(uint8_t *buffer, uint16_t bytes) {
-  bool res = false;    
+  return this->handleBytes(buffer, bytes);
+}
 
-  if (_stopme > millis()) 
-    for (uint16_t i = 0; i < bytes; i++) {
-      uint8_t b = buffer[i];
-          
-      if (parseImprovSerial(_position, b, _buffer)) {
-        _buffer[_position++] = b;
-        res = true;
-      } else {
-        _position = 0;
-      }
+bool ImprovWiFi::handleBytes(const uint8_t *data, size_t length) {
+  bool res = false;
+  size_t i = 0;
+
+  if (this->isDormant()) {
+    i = this->detectWake(data, length);
+    res = i > 0 && !this->isDormant();
+  }
+
+  // detectWake() consumed everything unless it woke the listener
+  for (; i < length; i++) {
+    if (parseImprovSerial(data[i])) {
+      res = true;
     }
+  }
   return res;
 }
 
+size_t ImprovWiFi::detectWake(const uint8_t *data, size_t length) {
+  size_t i = 0;
+
+  while (i < length) {
+    if (this->wakeMatched == 0) {
+      // skip ahead to the next candidate
+      const uint8_t *next = (const uint8_t *)memchr(data + i, this->wakeSequence[0], length - i);
+      if (!next) {
+        return length;
+      }
+      i = next - data;
+    }
+
+    uint8_t b = data[i++];
+
+    if (b == this->wakeSequence[this->wakeMatched]) {
+      this->wakeMatched++;
+    } else {
+      // longest prefix of the sequence which ends with this byte
+      uint8_t matched = this->wakeMatched;
+      this->wakeMatched = 0;
+      for (uint8_t k = matched; k > 0; k--) {
+        if (this->wakeSequence[k - 1] == b && memcmp(this->wakeSequence, this->wakeSequence + matched - k + 1, k - 1) == 0) {
+          this->wakeMatched = k;
+          break;
+        }
+      }
+    }
+
+    if (this->wakeMatched == this->wakeSequenceLength) {
+      this->wakeMatched = 0;
+      this->_stopme = clock->millis64() + IMPROV_RUN_FOR;
+      this->frame.reset();
+
+      if (!this->customWakeSequence) {
+        // the wake sequence is the header of the frame which is arriving
+        for (uint8_t k = 0; k < this->wakeSequenceLength; k++) {
+          this->frame.push(this->wakeSequence[k]);
+        }
+      }
+      return i;
+    }
+  }
+
+  return length;
+}
+
+void ImprovWiFi::setWakeSequence(const char *sequence) {
+  size_t length = sequence ? strlen(sequence) : 0;
+
+  if (length == 0 || length > IMPROV_WAKE_SEQUENCE_MAX) {
+    memcpy(this->wakeSequence, "IMPROV", 6);
+    this->wakeSequenceLength = 6;
+    this->customWakeSequence = false;
+  } else {
+    memcpy(this->wakeSequence, sequence, length);
+    this->wakeSequenceLength = length;
+    this->customWakeSequence = true;
+  }
+  this->wakeMatched = 0;
+}
 
 void ImprovWiFi::onErrorCallback(ImprovTypes::Error err)
 {
@@ -101,77 +214,257 @@ void ImprovWiFi::onErrorCallback(ImprovTypes::Error err)
   }
 }
 
-bool ImprovWiFi::onCommandCallback(ImprovTypes::ImprovCommand cmd)
+bool ImprovWiFi::onCommandCallback(const ImprovTypes::ImprovCommandView &cmd)
 {
+  uint8_t index = rpcIndex[cmd.command];
+  if (index == 0)
+  {
+    setError(ImprovTypes::ERROR_UNKNOWN_RPC);
+    return false;
+  }
+
+  // a copy: a handler which replaces or removes itself must not destroy the function it runs in
+  ImprovRpcHandler handler = rpcHandlers[index - 1];
+
+  // one per dispatch: a handler which waits calls checkSerial(), a frame arriving meanwhile is dispatched
+  // before this one returns and must not reuse its response
+  ImprovResponseEncoder response;
+  response.begin(cmd.command);
+  bool result = handler(cmd, response);
 
-  switch (cmd.command)
+  if (response.error() != ImprovTypes::ERROR_NONE)
   {
-  case ImprovTypes::Command::GET_CURRENT_STATE:
+    setError(response.error());
+  }
+  else if (response.overflowed())
   {
-    if (isConnected())
-    {
-      setState(ImprovTypes::State::STATE_PROVISIONED);
-      sendDeviceUrl(cmd.command);
-    }
-    else
-    {
-      setState(ImprovTypes::State::STATE_AUTHORIZED);
-    }
+    setError(ImprovTypes::ERROR_UNKNOWN);
+  }
+  else if (result && !response.isSkipped())
+  {
+    // without strings it is an empty response, which acknowledges the command
+    size_t size;
+    const uint8_t *data = response.finish(size);
+    serial->write(data, size);
+  }
+  return result;
+}
 
-    break;
+bool ImprovWiFi::registerRpcHandler(uint8_t command, ImprovRpcHandler handler)
+{
+  if (command == ImprovTypes::Command::UNKNOWN || command == ImprovTypes::Command::BAD_CHECKSUM)
+    return false;
+
+  uint8_t index = rpcIndex[command];
+  if (index != 0)
+  {
+    // replace in place, a removed slot stays empty until the command is registered again
+    rpcHandlers[index - 1] = handler;
+    if (!handler)
+      rpcIndex[command] = 0;
+    return true;
   }
 
-  case ImprovTypes::Command::WIFI_SETTINGS:
+  if (!handler)
+    return true;
+
+  // reuse the slot of a removed handler
+  auto slot = std::find_if(rpcHandlers.begin(), rpcHandlers.end(), [](const ImprovRpcHandler &h) { return !h; });
+  if (slot == rpcHandlers.end())
   {
+    rpcHandlers.push_back(handler);
+    slot = rpcHandlers.end() - 1;
+  }
+  else
+  {
+    *slot = handler;
+  }
+  rpcIndex[command] = (uint8_t)(slot - rpcHandlers.begin() + 1);
+  return true;
+}
 
-    if (cmd.ssid.empty())
-    {
-      setError(ImprovTypes::Error::ERROR_INVALID_RPC);
-      break;
-    }
+void ImprovWiFi::registerBuiltinRpcHandlers()
+{
+  // the built-in commands answer with their own (partly cached) frames instead of the encoder
+  registerRpcHandler(ImprovTypes::Command::GET_CURRENT_STATE,
+    [this](const ImprovTypes::ImprovCommandView &cmd, ImprovResponseEncoder &response) { response.skip(); return rpcGetCurrentState(cmd); });
+  registerRpcHandler(ImprovTypes::Command::WIFI_SETTINGS,
+    [this](const ImprovTypes::ImprovCommandView &cmd, ImprovResponseEncoder &response) { response.skip(); return rpcWiFiSettings(cmd); });
+  registerRpcHandler(ImprovTypes::Command::GET_DEVICE_INFO,
+    [this](const ImprovTypes::ImprovCommandView &cmd, ImprovResponseEncoder &response) { response.skip(); return rpcGetDeviceInfo(cmd); });
+  registerRpcHandler(ImprovTypes::Command::GET_WIFI_NETWORKS,
+    [this](const ImprovTypes::ImprovCommandView &cmd, ImprovResponseEncoder &response) { response.skip(); return rpcGetWiFiNetworks(cmd); });
+  registerRpcHandler(ImprovTypes::Command::SET_BAUD_RATE,
+    [this](const ImprovTypes::ImprovCommandView &cmd, ImprovResponseEncoder &response) { response.skip(); return rpcSetBaudRate(cmd); });
+}
+
+bool ImprovWiFi::rpcGetCurrentState(const ImprovTypes::ImprovCommandView &cmd)
+{
+  if (isConnected())
+  {
+    setState(ImprovTypes::State::STATE_PROVISIONED);
+    sendDeviceUrl(cmd.command);
+  }
+  else
+  {
+    setState(ImprovTypes::State::STATE_AUTHORIZED);
+  }
 
-    setState(ImprovTypes::STATE_PROVISIONING);
+  return true;
+}
 
-    bool success = false;
+bool ImprovWiFi::rpcWiFiSettings(const ImprovTypes::ImprovCommandView &cmd)
+{
+  // the view into the frame is not terminated, the strings are copied for the WiFi API
+  char ssid[33];
+  char password[65];
 
-    if (customConnectWiFiCallback)
-    {
-      success = customConnectWiFiCallback(cmd.ssid.c_str(), cmd.password.c_str());
+  if (cmd.ssidLength == 0 || cmd.ssidLength >= sizeof(ssid) || cmd.passwordLength >= sizeof(password))
+  {
+    setError(ImprovTypes::Error::ERROR_INVALID_RPC);
+    return true;
+  }
+
+  memcpy(ssid, cmd.ssid, cmd.ssidLength);
+  ssid[cmd.ssidLength] = '\0';
+  memcpy(password, cmd.password, cmd.passwordLength);
+  password[cmd.passwordLength] = '\0';
+
+  setState(ImprovTypes::STATE_PROVISIONING);
+
+  bool success = false;
+  this->settingsChannels = 0;
+
+  if (customConnectWiFiCallback)
+  {
+    success = customConnectWiFiCallback(ssid, password);
+  }
+  else if (!IMPROV_VALIDATE_WIFI_SETTINGS || validateWiFiSettings(ssid, password))
+  {
+    success = tryConnectToWifi(ssid, password);
+  }
+
+  if (success) {
+    // the roaming scan covers the channels the new network was seen on
+    this->knownChannels = this->settingsChannels | channelBit(WiFi.channel());
+
+    std::string ssidCopy(ssid);
+    std::string passwordCopy(password);
+
+    this->acceptCredentials(ssidCopy, passwordCopy);
+    
+    setError(ImprovTypes::Error::ERROR_NONE);
+    setState(ImprovTypes::STATE_PROVISIONED);
+    sendDeviceUrl(cmd.command);
+
+    for (auto &cb : onImprovProvisionedCallbacks) {
+      cb(ssid, password);
     }
-    else
-    {
-      success = tryConnectToWifi(cmd.ssid.c_str(), cmd.password.c_str());
+    
+    if (!onImprovConnectedCallbacks.empty()) {
+      for (auto &cb : onImprovConnectedCallbacks) {
+        cb(ssid, password);
+      }
     }
+  
+  }
+  else
+  {
+    setState(ImprovTypes::STATE_STOPPED);
+    setError(ImprovTypes::ERROR_UNABLE_TO_CONNECT);
+    onErrorCallback(ImprovTypes::ERROR_UNABLE_TO_CONNECT);
+  }
 
-    if (success) {
-      if (customWiFiCredentialSavingCallback) {
-        customWiFiCredentialSavingCallback(&cmd.ssid, &cmd.password);
-      } else {
-        this->saveWiFiCredentials(&cmd.ssid, &cmd.password);
-      }
-      
-      setError(ImprovTypes::Error::ERROR_NONE);
-      setState(ImprovTypes::STATE_PROVISIONED);
-      sendDeviceUrl(cmd.command);
-      
-      if (!onImprovConnectedCallbacks.empty()) {
-        for (auto &cb : onImprovConnectedCallbacks) {
-          cb(cmd.ssid.c_str(), cmd.password.c_str());
-        }
-      }
-    
+  memset(password, 0, sizeof(password));
+  return true;
+}
+
+bool ImprovWiFi::rpcGetDeviceInfo(const ImprovTypes::ImprovCommandView &)
+{
+  sendDeviceInfo();
+  return true;
+}
+
+bool ImprovWiFi::rpcGetWiFiNetworks(const ImprovTypes::ImprovCommandView &cmd)
+{
+  getAvailableWifiNetworks(cmd.dataLength > 0 && cmd.data[0] == ImprovTypes::NETWORK_LIST_COMPACT);
+  return true;
+}
+
+bool ImprovWiFi::rpcSetBaudRate(const ImprovTypes::ImprovCommandView &cmd)
+{
+  if (!baudRateSwitchCallback || baudRate == 0)
+  {
+    setError(ImprovTypes::ERROR_UNKNOWN_RPC);
+    return false;
+  }
+  return switchBaudRate(cmd);
+}
+
+void ImprovWiFi::setDeviceInfo(ImprovTypes::ChipFamily chipFamily, const char *firmwareName, const char *firmwareVersion, const char *deviceName)
+{
+  improvWiFiParams.chipFamily = chipFamily;
+  improvWiFiParams.firmwareName = firmwareName;
+  improvWiFiParams.firmwareVersion = firmwareVersion;
+  improvWiFiParams.deviceName = deviceName;
+  invalidateResponseCache();
+}
+void ImprovWiFi::setDeviceInfo(ImprovTypes::ChipFamily chipFamily, const char *firmwareName, const char *firmwareVersion, const char *deviceName, const char *deviceUrl)
+{
+  setDeviceInfo(chipFamily, firmwareName, firmwareVersion, deviceName);
+  improvWiFiParams.deviceUrl = deviceUrl;
+  invalidateResponseCache();
+}
+
+void ImprovWiFi::invalidateResponseCache()
+{
+  deviceInfoFrame.clear();
+  deviceUrlFrame.clear();
+}
+
+bool ImprovWiFi::isConnected()
+{
+  return (WiFi.status() == WL_CONNECTED);
+}
+
+void ImprovWiFi::sendDeviceUrl(ImprovTypes::Command cmd)
+{
+  // URL where user can finish onboarding or use device
+  // Recommended to use website hosted by device
+
+  const uint32_t ip = (uint32_t)WiFi.localIP();
+
+  // the frame depends on the command it answers and the current IP (DHCP may hand out a new one)
+  if (deviceUrlFrame.empty() || deviceUrlFrameIp != ip || deviceUrlFrameCmd != cmd)
+  {
+    const IPAddress address(ip);
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%d.%d.%d.%d", address[0], address[1], address[2], address[3]);
+    std::string ipStr = std::string{buffer};
+
+    // keep the template in improvWiFiParams untouched, resolve the placeholder on a copy
+    std::string url;
+    if (improvWiFiParams.deviceUrl.empty())
+    {
+      url = "http://" + ipStr;
     }
     else
     {
-      setState(ImprovTypes::STATE_STOPPED);
-      setError(ImprovTypes::ERROR_UNABLE_TO_CONNECT);
-      onErrorCallback(ImprovTypes::ERROR_UNABLE_TO_CONNECT);
+      url = improvWiFiParams.deviceUrl;
+      replaceAll(url, "{LOCAL_IPV4}", ipStr);
     }
 
-    break;
+    deviceUrlFrame = build_frame(ImprovTypes::TYPE_RPC_RESPONSE, build_rpc_response(cmd, {url}, false));
+    deviceUrlFrameIp = ip;
+    deviceUrlFrameCmd = cmd;
   }
 
-  case ImprovTypes::Command::GET_DEVICE_INFO:
+  serial->write(deviceUrlFrame.data(), deviceUrlFrame.size());
+}
+
+void ImprovWiFi::sendDeviceInfo()
+{
+  if (deviceInfoFrame.empty())
   {
     std::vector<std::string> infos = {
         // Firmware name
@@ -182,65 +475,483 @@ bool ImprovWiFi::onCommandCallback(ImprovTypes::ImprovCommand cmd)
         CHIP_FAMILY_DESC[improvWiFiParams.chipFamily],
         // Device name
         improvWiFiParams.deviceName};
-    std::vector<uint8_t> data = build_rpc_response(ImprovTypes::GET_DEVICE_INFO, infos, false);
-    sendResponse(data);
-    break;
+    deviceInfoFrame = build_frame(ImprovTypes::TYPE_RPC_RESPONSE, build_rpc_response(ImprovTypes::GET_DEVICE_INFO, infos, false));
   }
 
-  case ImprovTypes::Command::GET_WIFI_NETWORKS:
+  serial->write(deviceInfoFrame.data(), deviceInfoFrame.size());
+}
+
+bool ImprovWiFi::switchBaudRate(const ImprovTypes::ImprovCommandView &cmd)
+{
+  // payload is a single string with the decimal baud rate
+  if (cmd.dataLength < 2 || cmd.data[0] == 0 || cmd.data[0] > 7 || cmd.data[0] + 1 > cmd.dataLength)
   {
-    getAvailableWifiNetworks();
-    break;
+    setError(ImprovTypes::ERROR_INVALID_RPC);
+    return false;
   }
 
-  default:
+  uint32_t requested = 0;
+  for (uint8_t i = 1; i <= cmd.data[0]; i++)
   {
-    setError(ImprovTypes::ERROR_UNKNOWN_RPC);
+    if (cmd.data[i] < '0' || cmd.data[i] > '9')
+    {
+      setError(ImprovTypes::ERROR_INVALID_RPC);
+      return false;
+    }
+    requested = requested * 10 + (cmd.data[i] - '0');
+  }
+
+  // only faster rates: a slower one would not shorten the session and could fall below what the client supports
+  if (requested < baudRate || requested > maxBaudRate || baudRatePending)
+  {
+    setError(ImprovTypes::ERROR_INVALID_RPC);
     return false;
   }
+
+  Serial.printf("Switching baud rate from %lu to %lu\n", (unsigned long)baudRate, (unsigned long)requested);
+
+  // acknowledge at the old rate and make sure it left the UART before switching
+  std::vector<uint8_t> data = build_rpc_response(ImprovTypes::SET_BAUD_RATE, {std::to_string(requested)}, false);
+  sendResponse(data);
+  serial->flush();
+
+  if (requested == baudRate)
+    return true;
+
+  // the client follows the acknowledgement: tell it at the new rate that the switch failed, it goes back as well
+  if (!baudRateSwitchCallback(requested))
+  {
+    setError(ImprovTypes::ERROR_UNKNOWN);
+    serial->flush();
+    baudRateSwitchCallback(baudRate);
+    Serial.printf("Baud rate switch failed, back to %lu\n", (unsigned long)baudRate);
+    return false;
   }
 
+  previousBaudRate = baudRate;
+  baudRate = requested;
+  baudRatePending = true;
+  millisBaudRateSwitch = clock->millis64();
   return true;
 }
-void ImprovWiFi::setDeviceInfo(ImprovTypes::ChipFamily chipFamily, const char *firmwareName, const char *firmwareVersion, const char *deviceName)
+
+void ImprovWiFi::checkBaudRateTimeout()
 {
-  improvWiFiParams.chipFamily = chipFamily;
-  improvWiFiParams.firmwareName = firmwareName;
-  improvWiFiParams.firmwareVersion = firmwareVersion;
-  improvWiFiParams.deviceName = deviceName;
+  if (!baudRatePending || clock->millis64() - millisBaudRateSwitch < IMPROV_BAUD_CONFIRM_MS)
+    return;
+
+  baudRatePending = false;
+  baudRate = previousBaudRate;
+  baudRateSwitchCallback(baudRate);
+  frame.reset();
+  Serial.printf("No Improv frame received after baud rate switch, back to %lu\n", (unsigned long)baudRate);
 }
-void ImprovWiFi::setDeviceInfo(ImprovTypes::ChipFamily chipFamily, const char *firmwareName, const char *firmwareVersion, const char *deviceName, const char *deviceUrl)
-{
-  setDeviceInfo(chipFamily, firmwareName, firmwareVersion, deviceName);
-  improvWiFiParams.deviceUrl = deviceUrl;
+
+bool ImprovWiFi::scanForNetwork(const char *ssid, ImprovTypes::NetworkInfo &result, const uint8_t *channels, uint8_t channelCount) {
+  if (this->WifiDeviceIsLocked) {
+    return false;
+  }
+  this->finishRoamScan();
+  this->WifiDeviceIsLocked = true;
+
+  bool found = false;
+  result.channels = 0;
+  // channel 0 scans all channels
+  for (uint8_t c = 0; c < (channelCount ? channelCount : 1); c++) {
+    uint8_t channel = channelCount ? channels[c] : 0;
+    found = this->pickStrongest(ssid, this->startScan(ssid, channel, false), result, found);
+    WiFi.scanDelete();
+  }
+
+  this->WifiDeviceIsLocked = false;
+  return found;
 }
 
-bool ImprovWiFi::isConnected()
-{
-  return (WiFi.status() == WL_CONNECTED);
+int16_t ImprovWiFi::startScan(const char *ssid, uint8_t channel, bool async) {
+  #if defined(ARDUINO_ARCH_ESP8266)
+    return WiFi.scanNetworks(async, true, channel, (uint8 *)ssid);
+  #else
+    return WiFi.scanNetworks(async, true, false, IMPROV_SCAN_MS_PER_CHANNEL, channel, ssid);
+  #endif
+}
+
+bool ImprovWiFi::pickStrongest(const char *ssid, int16_t networkNum, ImprovTypes::NetworkInfo &result, bool found) {
+  for (int16_t i = 0; i < networkNum; i++) {
+    if (strcmp(WiFi.SSID(i).c_str(), ssid) != 0) { continue; }
+
+    result.channels |= channelBit(WiFi.channel(i));
+
+    int32_t rssi = WiFi.RSSI(i);
+    if (!found || rssi > result.rssi) {
+      result.rssi = std::max<int32_t>(-128, std::min<int32_t>(127, rssi));
+      result.channel = WiFi.channel(i);
+      memcpy(result.bssid, WiFi.BSSID(i), 6);
+      result.open = WiFi.encryptionType(i) == WIFI_OPEN;
+      found = true;
+    }
+  }
+  return found;
+}
+
+uint16_t ImprovWiFi::channelBit(int32_t channel) {
+  return channel >= 1 && channel <= 14 ? 1 << channel : 0;
+}
+
+bool ImprovWiFi::scanForSavedNetwork(ImprovTypes::NetworkInfo &result) {
+  // the last known channel answers within one dwell time, only fall back to all channels if it moved
+  if (this->lastChannel && this->scanForNetwork(this->SSID.c_str(), result, &this->lastChannel, 1)) {
+    return true;
+  }
+  if (this->scanForNetwork(this->SSID.c_str(), result)) {
+    this->lastChannel = result.channel;
+    this->knownChannels |= result.channels;
+    return true;
+  }
+  return false;
+}
+
+void ImprovWiFi::loadCachedLease() {
+  if (!this->leaseCacheEnabled || this->leaseLoaded) {
+    return;
+  }
+
+  this->leaseLoaded = true;
+  if (!this->loadLease(this->lease)) {
+    this->lease.version = 0;
+  }
+}
+
+void ImprovWiFi::applyCachedLease(const uint8_t *bssid) {
+  if (!this->leaseCacheEnabled) {
+    return;
+  }
+
+  this->loadCachedLease();
+
+  bool useLease = bssid && this->lease.version == ImprovTypes::LEASE_VERSION && memcmp(this->lease.bssid, bssid, 6) == 0;
+
+  if (useLease) {
+    WiFi.config(IPAddress(this->lease.ip), IPAddress(this->lease.gateway), IPAddress(this->lease.subnet), IPAddress(this->lease.dns1), IPAddress(this->lease.dns2));
+  } else if (this->leaseApplied) {
+    // back to DHCP
+    WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+  }
+
+  this->leaseApplied = useLease;
 }
 
-void ImprovWiFi::sendDeviceUrl(ImprovTypes::Command cmd)
-{
-  // URL where user can finish onboarding or use device
-  // Recommended to use website hosted by device
+// lwIP may only be called from its own thread on ESP32, the ESP8266 has no other thread
+static void runInLwip(void (*fn)(void *), void *arg) {
+#if defined(ARDUINO_ARCH_ESP32)
+  tcpip_callback(fn, arg);
+#else
+  fn(arg);
+#endif
+}
+
+void ImprovWiFi::storeCurrentLease() {
+  if (!this->leaseCacheEnabled || (uint32_t)WiFi.localIP() == 0) {
+    return;
+  }
+
+  // the lease time is only known to the DHCP client in lwIP
+  this->leaseTimeRead = false;
+  this->leaseStorePending = true;
+  runInLwip(readLeaseTime, this);
+  this->checkLeaseStore();
+}
+
+void ImprovWiFi::checkLeaseStore() {
+  if (!this->leaseStorePending || !this->leaseTimeRead) {
+    return;
+  }
+  this->leaseStorePending = false;
+  if ((uint32_t)WiFi.localIP() == 0) {
+    return;
+  }
+
+  ImprovTypes::DhcpLease current = {};
+  current.version = ImprovTypes::LEASE_VERSION;
+  memcpy(current.bssid, WiFi.BSSID(), 6);
+  current.channel = WiFi.channel();
+  current.ip = WiFi.localIP();
+  current.gateway = WiFi.gatewayIP();
+  current.subnet = WiFi.subnetMask();
+  current.dns1 = WiFi.dnsIP(0);
+  current.dns2 = WiFi.dnsIP(1);
+  current.leaseSeconds = this->leaseTimeSeconds;
+
+  // only touch the flash if something changed
+  if (memcmp(&current, &this->lease, sizeof(current)) != 0 && this->saveLease(current)) {
+    this->lease = current;
+    this->leaseLoaded = true;
+  }
+}
+
+void ImprovWiFi::readLeaseTime(void *arg) {
+  ImprovWiFi *self = (ImprovWiFi *)arg;
+  struct netif *netif = netif_default;
+
+  // 0 unless the address came from DHCP
+  self->leaseTimeSeconds = netif && dhcp_supplied_address(netif) ? netif_dhcp_data(netif)->offered_t0_lease : 0;
+  self->leaseTimeRead = true;
+}
+
+void ImprovWiFi::sendLeaseProbe(void *arg) {
+  struct netif *netif = netif_default;
+  if (netif == nullptr) {
+    return;
+  }
+
+  // a host holding the same address answers the announcement, the gateway its request
+  etharp_gratuitous(netif);
+  etharp_request(netif, netif_ip4_gw(netif));
+}
+
+void ImprovWiFi::readLeaseProbe(void *arg) {
+  ImprovWiFi *self = (ImprovWiFi *)arg;
+  struct netif *netif = netif_default;
+  struct eth_addr *mac;
+  const ip4_addr_t *ip;
+
+  self->leaseGatewayFound = netif && etharp_find_addr(netif, netif_ip4_gw(netif), &mac, &ip) >= 0;
+  self->leaseConflict = netif && etharp_find_addr(netif, netif_ip4_addr(netif), &mac, &ip) >= 0;
+  self->leaseProbeDone = true;
+}
+
+void ImprovWiFi::checkLease() {
+  if (!this->leaseApplied || this->leaseCheck == LEASE_CHECK_DONE) {
+    return;
+  }
+
+  uint64_t now = clock->millis64();
+
+  switch (this->leaseCheck) {
+    case LEASE_CHECK_WAIT:
+      if (now - this->millisLeaseValidate < IMPROV_LEASE_VALIDATE_DELAY_MS) {
+        return;
+      }
+      // the interface keeps its address while the probe runs
+      runInLwip(sendLeaseProbe, this);
+      this->leaseCheck = LEASE_CHECK_ARP;
+      this->millisLeaseValidate = now;
+      return;
+
+    case LEASE_CHECK_ARP:
+      if (now - this->millisLeaseValidate < IMPROV_LEASE_VALIDATE_TIMEOUT_MS) {
+        return;
+      }
+      this->leaseProbeDone = false;
+      runInLwip(readLeaseProbe, this);
+      this->leaseCheck = LEASE_CHECK_READ;
+      // fall through
+
+    case LEASE_CHECK_READ:
+      if (!this->leaseProbeDone) {
+        return;
+      }
+      if (this->leaseGatewayFound && !this->leaseConflict) {
+        this->leaseCheck = LEASE_CHECK_RENEW;
+        return;
+      }
+      Serial.println(this->leaseConflict ? F("Cached IP is taken by another host, asking DHCP") : F("Gateway of the cached lease did not answer, asking DHCP"));
+      WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+      this->leaseCheck = LEASE_CHECK_DHCP;
+      this->millisLeaseValidate = now;
+      return;
+
+    case LEASE_CHECK_RENEW:
+      // the DHCP server does not know the address is still in use, hand over before it gives it away
+      if (now - this->millisLeaseApplied < this->leaseRenewMs()) {
+        return;
+      }
+      Serial.println(F("Cached lease is due, asking DHCP"));
+      WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+      this->leaseCheck = LEASE_CHECK_DHCP;
+      this->millisLeaseValidate = now;
+      return;
+
+    case LEASE_CHECK_DHCP:
+      if ((uint32_t)WiFi.localIP() == 0 && now - this->millisLeaseValidate < IMPROV_LEASE_VALIDATE_TIMEOUT_MS) {
+        return;
+      }
+      break;
+
+    case LEASE_CHECK_DONE:
+      return;
+  }
+
+  this->leaseCheck = LEASE_CHECK_DONE;
+  this->leaseApplied = false;
+
+  if ((uint32_t)WiFi.localIP() == 0) {
+    // no answer from DHCP either, stay reachable at the cached address and ask again later
+    Serial.println(F("DHCP did not answer, keeping cached lease"));
+    this->applyCachedLease(WiFi.BSSID());
+    if (this->leaseApplied) {
+      this->leaseCheck = LEASE_CHECK_RENEW;
+      this->millisLeaseApplied = now;
+    }
+    return;
+  }
+
+  Serial.print(F("Cached lease replaced, DHCP assigned IP: "));
+  Serial.println(WiFi.localIP().toString().c_str());
+  this->storeCurrentLease();
+}
+
+uint64_t ImprovWiFi::leaseRenewMs() {
+  // T1 of the cached lease, when a DHCP client would have renewed it
+  uint64_t renewMs = (uint64_t)this->lease.leaseSeconds * 1000 / 2;
+  if (renewMs == 0 || renewMs > IMPROV_LEASE_RENEW_MAX_MS) {
+    renewMs = IMPROV_LEASE_RENEW_MAX_MS;
+  }
+  return renewMs;
+}
+
+void ImprovWiFi::enableRoaming(int8_t threshold, uint8_t hysteresis) {
+  this->roamingEnabled = true;
+  this->roamThreshold = threshold;
+  this->roamHysteresis = hysteresis;
+  this->rssiSamples = 0;
+}
+
+void ImprovWiFi::checkLinkQuality() {
+  uint64_t now = clock->millis64();
+
+  if (this->roamScanChannel) {
+    this->pollRoamScan();
+    return;
+  }
+
+  if (!this->roamingEnabled || this->SSID.isEmpty() || now - this->millisLastRssiSample < IMPROV_RSSI_SAMPLE_MS) {
+    return;
+  }
+  this->millisLastRssiSample = now;
+
+  // exponentially weighted moving average, alpha = 1/8
+  int32_t rssi = WiFi.RSSI();
+  if (this->rssiSamples == 0) {
+    this->rssiAverage = rssi * 16;
+  } else {
+    this->rssiAverage += (rssi * 16 - this->rssiAverage) / 8;
+  }
+
+  // judge the link only once the average has settled
+  if (this->rssiSamples < 8) {
+    this->rssiSamples++;
+    return;
+  }
+
+  int32_t average = this->rssiAverage / 16;
+  if (average >= this->roamThreshold || this->WifiDeviceIsLocked ||
+    (this->millisLastRoam != 0 && now - this->millisLastRoam < IMPROV_ROAM_HOLDOFF_MS)) {
+    return;
+  }
+  // also spaces out scans which find nothing better
+  this->millisLastRoam = now;
+
+  // scan in the background, loop() polls the result; one channel at a time if the channels of the network are known
+  this->roamCandidateFound = false;
+  this->roamCandidate.channels = 0;
+  this->roamScanChannel = ROAM_SCAN_ALL_CHANNELS;
+  uint8_t first = this->nextKnownChannel(0);
+  if (first && this->nextKnownChannel(first)) {
+    this->roamScanChannel = first;
+  }
+  this->startScan(this->SSID.c_str(), this->roamScanChannel == ROAM_SCAN_ALL_CHANNELS ? 0 : this->roamScanChannel, true);
+}
+
+uint8_t ImprovWiFi::nextKnownChannel(uint8_t channel) {
+  for (uint8_t c = channel + 1; c <= 14; c++) {
+    if (this->knownChannels & (1 << c)) {
+      return c;
+    }
+  }
+  return 0;
+}
+
+void ImprovWiFi::pollRoamScan() {
+  int16_t networkNum = WiFi.scanComplete();
+  if (networkNum == WIFI_SCAN_RUNNING) {
+    return;
+  }
+
+  this->roamCandidateFound = this->pickStrongest(this->SSID.c_str(), networkNum, this->roamCandidate, this->roamCandidateFound);
+  WiFi.scanDelete();
+
+  uint8_t next = this->roamScanChannel == ROAM_SCAN_ALL_CHANNELS ? 0 : this->nextKnownChannel(this->roamScanChannel);
+  if (next) {
+    this->roamScanChannel = next;
+    this->startScan(this->SSID.c_str(), next, true);
+    return;
+  }
+  this->roamScanChannel = 0;
+  this->knownChannels |= this->roamCandidate.channels;
+
+  int32_t average = this->rssiAverage / 16;
+  const ImprovTypes::NetworkInfo &candidate = this->roamCandidate;
+  if (!this->roamCandidateFound ||
+    memcmp(candidate.bssid, WiFi.BSSID(), 6) == 0 ||
+    candidate.rssi < average + this->roamHysteresis) {
+    return;
+  }
+
+  Serial.printf("Link at %d dBm, roaming to AP %02X:%02X:%02X:%02X:%02X:%02X on channel %u (%d dBm)\n", (int)average, candidate.bssid[0], candidate.bssid[1], candidate.bssid[2], candidate.bssid[3], candidate.bssid[4], candidate.bssid[5], candidate.channel, candidate.rssi);
+  this->setBSSID(candidate.bssid);
+  this->lastChannel = candidate.channel;
+  this->roaming = true;
+  this->millisLastRoam = clock->millis64();
+  WiFi.disconnect(false);
+  WiFi.begin(this->SSID.c_str(), this->PASSWORD.c_str(), candidate.channel, candidate.bssid);
+}
+
+void ImprovWiFi::finishRoamScan() {
+  if (!this->roamScanChannel) {
+    return;
+  }
+  // the radio takes one scan at a time, wait for the running one (one dwell time per channel) and drop it
+  while (WiFi.scanComplete() == WIFI_SCAN_RUNNING) {
+    this->checkSerial();
+    clock->sleep(10);
+  }
+  WiFi.scanDelete();
+  this->roamScanChannel = 0;
+}
+
+bool ImprovWiFi::provision(const char *ssid, const char *password) {
+  bool success;
+  this->settingsChannels = 0;
+
+  if (customConnectWiFiCallback) {
+    success = customConnectWiFiCallback(ssid, password);
+  } else {
+    success = tryConnectToWifi(ssid, password);
+  }
+
+  if (!success) {
+    return false;
+  }
 
-  const IPAddress address = WiFi.localIP();
-  char buffer[16];
-  sprintf(buffer, "%d.%d.%d.%d", address[0], address[1], address[2], address[3]);
-  std::string ipStr = std::string{buffer};
+  // the roaming scan covers the channels the new network was seen on
+  this->knownChannels = this->settingsChannels | channelBit(WiFi.channel());
 
-  if (improvWiFiParams.deviceUrl.empty())
-  {
-    improvWiFiParams.deviceUrl = "http://" + ipStr;
+  std::string ssidCopy(ssid);
+  std::string passwordCopy(password);
+  this->acceptCredentials(ssidCopy, passwordCopy);
+
+  for (auto &cb : onImprovProvisionedCallbacks) {
+    cb(ssid, password);
   }
-  else
-  {
-    replaceAll(improvWiFiParams.deviceUrl, "{LOCAL_IPV4}", ipStr);
+  for (auto &cb : onImprovConnectedCallbacks) {
+    cb(ssid, password);
   }
+  return true;
+}
 
-  std::vector<uint8_t> data = build_rpc_response(cmd, {improvWiFiParams.deviceUrl}, false);
-  sendResponse(data);
+void ImprovWiFi::setClock(ImprovClock *clock) {
+  this->clock = clock;
+  this->_stopme = clock->millis64() + IMPROV_RUN_FOR;
 }
 
 void ImprovWiFi::setBSSID(const uint8_t mac[6]) {
@@ -261,6 +972,7 @@ bool ImprovWiFi::ConnectToWifi() {
           std::string ssid = WIFISSID;
           std::string password = WIFIPASSWORD;
           this->saveWiFiCredentials(&ssid, &password);
+          this->WifiCredentialsAvailable = true;
           this->SSID = WIFISSID;
           this->PASSWORD = WIFIPASSWORD;
           
@@ -279,9 +991,10 @@ bool ImprovWiFi::ConnectToWifi() {
   }
 
   this->millisLastConnectTry = 0;
+  this->finishRoamScan();
 
   while (WiFi.status() != WL_CONNECTED) {
-    unsigned long currentMillis = millis();
+    uint64_t currentMillis = clock->millis64();
     this->checkSerial();
        
     if(this->numConnectRetriesDone == 0) {
@@ -292,42 +1005,77 @@ bool ImprovWiFi::ConnectToWifi() {
     
     if(this->numConnectRetriesDone > 0 && 
       this->numConnectRetriesDone < this->maxConnectRetries && 
-      currentMillis - this->millisLastConnectTry < 30000) {
-      // try to connect to wifi every 30seconds until max retries are reached
+      currentMillis - this->millisLastConnectTry < IMPROV_RECONNECT_INTERVAL_MS) {
+      // try to connect to wifi every IMPROV_RECONNECT_INTERVAL_MS until max retries are reached
+      clock->sleep(10);
       continue;
     }
 
     if (this->numConnectRetriesDone < this->maxConnectRetries) {
       this->millisLastConnectTry = currentMillis;
 
+      bool networkMissing = false;
+
       if (!this->WifiDeviceIsLocked) {
+        ImprovTypes::NetworkInfo network;
+        bool lateRetry = this->numConnectRetriesDone >= (uint16_t)(this->maxConnectRetries/3);
+
         if (!(this->BSSID[0] == 0 && this->BSSID[1] == 0 && this->BSSID[2] == 0 && 
           this->BSSID[3] == 0 && this->BSSID[4] == 0 && this->BSSID[5] == 0) &&
-          this->numConnectRetriesDone < (uint16_t)(this->maxConnectRetries/3)) {
+          !lateRetry) {
           // if BSSID is set and we are in the first third of max retries, try to connect with BSSID to avoid connecting to any AP with same SSID
           Serial.printf("Try connect to AP with BSSID %02X:%02X:%02X:%02X:%02X:%02X\n", this->BSSID[0], this->BSSID[1], this->BSSID[2], this->BSSID[3], this->BSSID[4], this->BSSID[5]);
+          this->applyCachedLease(this->BSSID);
           WiFi.begin(this->SSID.c_str(), this->PASSWORD.c_str(), 0, this->BSSID);
-        } else {
+        } else if (this->numConnectRetriesDone == 0) {
+          // no probe on the first attempt, it would only repeat the scan of WiFi.begin(); the retries probe
+          this->loadCachedLease();
+          if (this->lease.version == ImprovTypes::LEASE_VERSION && this->lease.channel) {
+            Serial.printf("Try connect to last AP %02X:%02X:%02X:%02X:%02X:%02X on channel %u\n", this->lease.bssid[0], this->lease.bssid[1], this->lease.bssid[2], this->lease.bssid[3], this->lease.bssid[4], this->lease.bssid[5], this->lease.channel);
+            this->applyCachedLease(this->lease.bssid);
+            WiFi.begin(this->SSID.c_str(), this->PASSWORD.c_str(), this->lease.channel, this->lease.bssid);
+          } else {
+            Serial.println(F("Try to connect..."));
+            this->applyCachedLease(nullptr);
+            WiFi.begin(this->SSID.c_str(), this->PASSWORD.c_str(), this->lastChannel);
+          }
+        } else if (this->scanForSavedNetwork(network)) {
+          Serial.printf("Try connect to AP %02X:%02X:%02X:%02X:%02X:%02X on channel %u (%d dBm)\n", network.bssid[0], network.bssid[1], network.bssid[2], network.bssid[3], network.bssid[4], network.bssid[5], network.channel, network.rssi);
+          this->applyCachedLease(network.bssid);
+          WiFi.begin(this->SSID.c_str(), this->PASSWORD.c_str(), network.channel, network.bssid);
+        } else if (lateRetry) {
+          // the probe may miss an AP, do not rely on it for the remaining retries
           Serial.println(F("Try to connect..."));
+          this->applyCachedLease(nullptr);
           WiFi.begin(this->SSID.c_str(), this->PASSWORD.c_str());
+        } else {
+          Serial.printf("%s not in range\n", this->SSID.c_str());
+          networkMissing = true;
         }
       }
 
-      // wifi connect needs some time, wait 5 seconds
-      uint16_t timeout=5000;
-      uint32_t start = millis();
-      while (WiFi.status() != WL_CONNECTED && millis() - start < timeout) {
+      // wifi connect needs some time
+      uint32_t timeout=IMPROV_CONNECT_TIMEOUT_MS;
+      uint64_t start = clock->millis64();
+      while (!networkMissing && WiFi.status() != WL_CONNECTED && clock->millis64() - start < timeout) {
         this->checkSerial();
-        delay(100);
+        clock->sleep(100);
       }
 
       if (WiFi.status() != WL_CONNECTED) {
         this->numConnectRetriesDone++;
-        Serial.printf("Waiting %dsec, try to connect %u/%u\n", (this->millisLastConnectTry + 30000 - millis()) / 1000, this->numConnectRetriesDone, this->maxConnectRetries);
+        if (this->leaseApplied) {
+          // maybe the cached lease is the problem, use DHCP for the next attempts
+          this->lease.version = 0;
+          this->applyCachedLease(nullptr);
+        }
+        Serial.printf("Waiting %dsec, try to connect %u/%u\n", (int)((this->millisLastConnectTry + IMPROV_RECONNECT_INTERVAL_MS - clock->millis64()) / 1000), this->numConnectRetriesDone, this->maxConnectRetries);
         WiFi.disconnect(false);
       } else {
-        Serial.println("\nWiFi Connected!");
+        Serial.printf("\nWiFi Connected after %lu ms%s!\n", (unsigned long)(clock->millis64() - start), this->leaseApplied ? " (cached lease)" : "");
         this->numConnectRetriesDone = 0;
+        this->lastChannel = WiFi.channel();
+        this->knownChannels |= channelBit(this->lastChannel);
               
         if (!onImprovConnectedCallbacks.empty()) {
           for (auto &cb : onImprovConnectedCallbacks) {
@@ -354,46 +1102,158 @@ bool ImprovWiFi::ConnectToWifi() {
 }
 
 bool ImprovWiFi::tryConnectToWifi(const char *ssid, const char *password) {
-  //TODO - improve this function
   uint8_t count = 0;
 
+  this->finishRoamScan();
   if (isConnected())
   {
     WiFi.disconnect();
-    delay(100);
+    clock->sleep(100);
   }
 
+  #if defined(ARDUINO_ARCH_ESP32)
+    // WiFi.status() does not tell a wrong password from a timeout, the disconnect reason does
+    this->disconnectReason = 0;
+    wifi_event_id_t eventId = WiFi.onEvent([this](arduino_event_id_t event, arduino_event_info_t info) {
+      this->disconnectReason = info.wifi_sta_disconnected.reason;
+    }, ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+  #endif
+
   WiFi.begin(ssid, password);
 
+  bool result = true;
   while (!isConnected())
   {
-    delay(DELAY_MS_WAIT_WIFI_CONNECTION);
+    clock->sleep(DELAY_MS_WAIT_WIFI_CONNECTION);
+    if (isAuthFailure())
+    {
+      Serial.printf("Password rejected by %s\n", ssid);
+      result = false;
+      break;
+    }
+    if (WiFi.status() == WL_NO_SSID_AVAIL)
+    {
+      Serial.printf("%s not found\n", ssid);
+      result = false;
+      break;
+    }
     if (count > MAX_ATTEMPTS_WIFI_CONNECTION)
     {
-      WiFi.disconnect();
-      return false;
+      result = false;
+      break;
     }
     count++;
   }
 
+  #if defined(ARDUINO_ARCH_ESP32)
+    WiFi.removeEvent(eventId);
+  #endif
+
+  if (!result)
+  {
+    WiFi.disconnect();
+  }
+  return result;
+}
+
+bool ImprovWiFi::isAuthFailure() {
+  #if defined(ARDUINO_ARCH_ESP8266)
+    return WiFi.status() == WL_WRONG_PASSWORD;
+  #else
+    switch (this->disconnectReason) {
+      case WIFI_REASON_AUTH_FAIL:
+      case WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT:
+      case WIFI_REASON_HANDSHAKE_TIMEOUT:
+      case WIFI_REASON_MIC_FAILURE:
+        return true;
+      default:
+        return false;
+    }
+  #endif
+}
+
+bool ImprovWiFi::validateWiFiSettings(const char *ssid, const char *password) {
+  bool found = false;
+  bool open = false;
+
+  // a recent GET_WIFI_NETWORKS answers most requests without touching the radio
+  if (!this->scanCache.empty() && clock->millis64() - this->millisLastScan < IMPROV_SCAN_CACHE_MS) {
+    uint32_t hash = hashSsid(ssid, strlen(ssid));
+    for (const auto &network : this->scanCache) {
+      if (network.ssidHash == hash) {
+        open = found ? open : network.open;
+        found = true;
+        this->settingsChannels |= channelBit(network.channel);
+      }
+    }
+  }
+
+  // hidden networks are not part of the scan, ask for the SSID directly
+  if (!found) {
+    ImprovTypes::NetworkInfo network = {};
+    found = this->scanForNetwork(ssid, network);
+    open = network.open;
+    this->settingsChannels = network.channels;
+  }
+
+  if (!found) {
+    Serial.printf("%s not in range\n", ssid);
+    return false;
+  }
+  if (open && password[0] != '\0') {
+    Serial.printf("%s is an open network, but a password was given\n", ssid);
+    return false;
+  }
+  if (!open && password[0] == '\0') {
+    Serial.printf("%s requires a password\n", ssid);
+    return false;
+  }
   return true;
 }
 
-void ImprovWiFi::getAvailableWifiNetworks() {
+uint32_t ImprovWiFi::hashSsid(const char *ssid, size_t length) {
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ (uint8_t)ssid[i]) * 16777619u;
+  }
+  return hash;
+}
+
+void ImprovWiFi::getAvailableWifiNetworks(bool compact) {
   // wait until wifi device is getting free
   while(this->WifiDeviceIsLocked) {
     this->checkSerial();
-    delay(100);
+    clock->sleep(100);
   }
 
   // lock wifi device to avoid multiple calls of starting wifi connection in the same time (reconnect vs. getAvailableNetworks)
+  this->finishRoamScan();
   this->WifiDeviceIsLocked = true;
 
-  uint16_t networkNum = WiFi.scanNetworks(false, false); // Wait for scan result, hide hidden
+  int16_t networkNum = WiFi.scanNetworks(false, false); // Wait for scan result, hide hidden
 
-  if (networkNum==0)
+  if (networkNum <= 0)
       networkNum = WiFi.scanNetworks(false, false); 
 
+  this->scanCache.clear();
+  if (networkNum < 0) {
+    // WIFI_SCAN_FAILED, only the final response is sent
+    std::vector<uint8_t> data = build_rpc_response(ImprovTypes::GET_WIFI_NETWORKS, std::vector<std::string>{}, false);
+    sendResponse(data);
+    this->WifiDeviceIsLocked = false;
+    return;
+  }
+
+  this->millisLastScan = clock->millis64();
+  for (int16_t i = 0; i < networkNum; i++) {
+    String ssid = WiFi.SSID(i);
+    this->scanCache.push_back({hashSsid(ssid.c_str(), ssid.length()), WiFi.encryptionType(i) == WIFI_OPEN, (uint8_t)WiFi.channel(i)});
+    if (ssid == this->SSID) {
+      this->knownChannels |= channelBit(WiFi.channel(i));
+    }
+  }
+
   if (networkNum) {
       int indices[networkNum];
       
@@ -408,28 +1268,31 @@ void ImprovWiFi::getAvailableWifiNetworks() {
         }
       }
       
-      // Remove duplicate SSIDs - IMPROV does not distinguish between channels so no need to keep them
-      for (uint16_t i = 0; i < networkNum; i++) {
-        if (-1 == indices[i]) { continue; }
-        String cssid = WiFi.SSID(indices[i]);
-        for (uint16_t j = i + 1; j < networkNum; j++) {
-	        if (cssid == WiFi.SSID(indices[j])) {
-		        indices[j] = -1; // Set dup aps to index -1
-	        }
+      if (compact) {
+        sendCompactNetworkList(indices, networkNum);
+      } else {
+        // Remove duplicate SSIDs - IMPROV does not distinguish between channels so no need to keep them
+        for (uint16_t i = 0; i < networkNum; i++) {
+          if (-1 == indices[i]) { continue; }
+          String cssid = WiFi.SSID(indices[i]);
+          for (uint16_t j = i + 1; j < networkNum; j++) {
+            if (cssid == WiFi.SSID(indices[j])) {
+              indices[j] = -1; // Set dup aps to index -1
+            }
+          }
+        }
+
+        // Send networks
+        for (uint16_t i = 0; i < networkNum; i++) {
+          if (-1 == indices[i]) { continue; }                  // Skip dups
+          String ssid_copy = WiFi.SSID(indices[i]);
+          if (!ssid_copy.length()) { ssid_copy = F("no_name"); }
+
+          std::vector<std::string> wifinetworks = { ssid_copy.c_str(), std::to_string(WiFi.RSSI(indices[i])), ( WiFi.encryptionType(indices[i]) == WIFI_OPEN ? "NO" : "YES") };
+          std::vector<uint8_t> data = build_rpc_response( ImprovTypes::GET_WIFI_NETWORKS, wifinetworks, false);
+          sendResponse(data);
+          clock->sleep(1);
         }
-      }
-      
-  
-      // Send networks
-      for (uint16_t i = 0; i < networkNum; i++) {
-        if (-1 == indices[i]) { continue; }                  // Skip dups
-        String ssid_copy = WiFi.SSID(indices[i]);
-        if (!ssid_copy.length()) { ssid_copy = F("no_name"); }
-
-        std::vector<std::string> wifinetworks = { ssid_copy.c_str(), std::to_string(WiFi.RSSI(indices[i])), ( WiFi.encryptionType(indices[i]) == WIFI_OPEN ? "NO" : "YES") };
-        std::vector<uint8_t> data = build_rpc_response( ImprovTypes::GET_WIFI_NETWORKS, wifinetworks, false);
-        sendResponse(data);
-        delay(1);
       }
   }
 
@@ -441,6 +1304,68 @@ void ImprovWiFi::getAvailableWifiNetworks() {
   this->WifiDeviceIsLocked = false;
 }
 
+void ImprovWiFi::sendCompactNetworkList(const int *indices, uint16_t networkNum) {
+  // every AP is listed, the BSSID tells them apart
+  std::vector<uint8_t> data;
+  data.reserve(255);
+
+  for (uint16_t i = 0; i < networkNum; i++) {
+    String ssid = WiFi.SSID(indices[i]);
+    uint8_t ssid_len = std::min<size_t>(ssid.length(), 32);
+    int32_t rssi = std::max<int32_t>(-128, std::min<int32_t>(127, WiFi.RSSI(indices[i])));
+    const uint8_t *bssid = WiFi.BSSID(indices[i]);
+
+    // command and length byte plus records must fit into one response
+    if (data.size() + 1 + ssid_len + 9 > 255) {
+      data[1] = data.size() - 2;
+      sendResponse(data);
+      data.clear();
+    }
+    if (data.empty()) {
+      data.push_back(ImprovTypes::GET_WIFI_NETWORKS);
+      data.push_back(0);
+    }
+
+    data.push_back(ssid_len);
+    data.insert(data.end(), ssid.c_str(), ssid.c_str() + ssid_len);
+    data.push_back((uint8_t)(int8_t)rssi);
+    data.push_back((uint8_t)WiFi.channel(indices[i]));
+    data.push_back(networkAuth(WiFi.encryptionType(indices[i])));
+    data.insert(data.end(), bssid, bssid + 6);
+  }
+
+  if (!data.empty()) {
+    data[1] = data.size() - 2;
+    sendResponse(data);
+  }
+}
+
+ImprovTypes::NetworkAuth ImprovWiFi::networkAuth(int encryptionType) {
+  // the platform enums differ, the wire value must not
+  #if defined(ARDUINO_ARCH_ESP8266)
+    switch (encryptionType) {
+      case ENC_TYPE_NONE: return ImprovTypes::AUTH_OPEN;
+      case ENC_TYPE_WEP:  return ImprovTypes::AUTH_WEP;
+      case ENC_TYPE_TKIP: return ImprovTypes::AUTH_WPA_PSK;
+      case ENC_TYPE_CCMP: return ImprovTypes::AUTH_WPA2_PSK;
+      case ENC_TYPE_AUTO: return ImprovTypes::AUTH_WPA_WPA2_PSK;
+      default:            return ImprovTypes::AUTH_OTHER;
+    }
+  #else
+    switch (encryptionType) {
+      case WIFI_AUTH_OPEN:            return ImprovTypes::AUTH_OPEN;
+      case WIFI_AUTH_WEP:             return ImprovTypes::AUTH_WEP;
+      case WIFI_AUTH_WPA_PSK:         return ImprovTypes::AUTH_WPA_PSK;
+      case WIFI_AUTH_WPA2_PSK:        return ImprovTypes::AUTH_WPA2_PSK;
+      case WIFI_AUTH_WPA_WPA2_PSK:    return ImprovTypes::AUTH_WPA_WPA2_PSK;
+      case WIFI_AUTH_WPA2_ENTERPRISE: return ImprovTypes::AUTH_WPA2_ENTERPRISE;
+      case WIFI_AUTH_WPA3_PSK:        return ImprovTypes::AUTH_WPA3_PSK;
+      case WIFI_AUTH_WPA2_WPA3_PSK:   return ImprovTypes::AUTH_WPA2_WPA3_PSK;
+      default:                        return ImprovTypes::AUTH_OTHER;
+    }
+  #endif
+}
+
 inline void ImprovWiFi::replaceAll(std::string &str, const std::string &from, const std::string &to)
 {
   size_t start_pos = 0;
@@ -451,162 +1376,85 @@ inline void ImprovWiFi::replaceAll(std::string &str, const std::string &from, co
   }
 }
 
-bool ImprovWiFi::parseImprovSerial(size_t position, uint8_t byte, const uint8_t *buffer)
+bool ImprovWiFi::parseImprovSerial(uint8_t byte)
 {
-  if (position == 0)
-    return byte == 'I';
-  if (position == 1)
-    return byte == 'M';
-  if (position == 2)
-    return byte == 'P';
-  if (position == 3)
-    return byte == 'R';
-  if (position == 4)
-    return byte == 'O';
-  if (position == 5)
-    return byte == 'V';
-
-  if (position == 6)
-    return byte == ImprovTypes::IMPROV_SERIAL_VERSION;
-
-  if (position <= 8)
+  switch (frame.push(byte))
+  {
+  case ImprovFrameAssembler::FRAME_INCOMPLETE:
     return true;
 
-  uint8_t type = buffer[7];
-  uint8_t data_len = buffer[8];
+  case ImprovFrameAssembler::FRAME_BAD_CHECKSUM:
+    onErrorCallback(ImprovTypes::Error::ERROR_INVALID_RPC);
+    return false;
 
-  if (position <= 8 + (size_t)data_len)
-    return true;
+  case ImprovFrameAssembler::FRAME_COMPLETE:
+    break;
 
-  if (position == 8 + (size_t)data_len + 1)
-  {
-    uint8_t checksum = 0x00;
-    for (size_t i = 0; i < position; i++)
-      checksum += buffer[i];
+  default:
+    return false;
+  }
 
-    if (checksum != byte)
-    {
-      _position = 0;
-      onErrorCallback(ImprovTypes::Error::ERROR_INVALID_RPC);
-      return false;
-    }
+  _stopme = clock->millis64() + IMPROV_RUN_FOR;
+  // any valid frame at a newly negotiated rate completes the handshake
+  baudRatePending = false;
 
-    _stopme = millis() + IMPROV_RUN_FOR;
-    
-    if (type == ImprovTypes::ImprovSerialType::TYPE_RPC)
-    {
-      _position = 0;
-      auto command = parseImprovData(&buffer[9], data_len, false);
-      return onCommandCallback(command);
-    }
-  }
+  if (frame.type() != ImprovTypes::ImprovSerialType::TYPE_RPC)
+    return true;
 
-  return false;
+  ImprovTypes::ImprovCommandView command;
+  if (!ImprovRpcDecoder::decode(frame.payload(), frame.payloadLength(), command))
+  {
+    setError(ImprovTypes::Error::ERROR_INVALID_RPC);
+    onErrorCallback(ImprovTypes::Error::ERROR_INVALID_RPC);
+    return false;
+  }
+  return onCommandCallback(command);
 }
 
-ImprovTypes::ImprovCommand ImprovWiFi::parseImprovData(const std::vector<uint8_t> &data, bool check_checksum)
+void ImprovWiFi::setState(ImprovTypes::State state)
 {
-  return parseImprovData(data.data(), data.size(), check_checksum);
+  sendStatusFrame(ImprovTypes::TYPE_CURRENT_STATE, state);
 }
 
-ImprovTypes::ImprovCommand ImprovWiFi::parseImprovData(const uint8_t *data, size_t length, bool check_checksum)
+void ImprovWiFi::setError(ImprovTypes::Error error)
 {
-  ImprovTypes::ImprovCommand improv_command;
-  ImprovTypes::Command command = (ImprovTypes::Command)data[0];
-  uint8_t data_length = data[1];
-
-  if (data_length != length - 2 - check_checksum)
-  {
-    improv_command.command = ImprovTypes::Command::UNKNOWN;
-    return improv_command;
-  }
-
-  if (check_checksum)
-  {
-    uint8_t checksum = data[length - 1];
-
-    uint32_t calculated_checksum = 0;
-    for (uint8_t i = 0; i < length - 1; i++)
-    {
-      calculated_checksum += data[i];
-    }
-
-    if ((uint8_t)calculated_checksum != checksum)
-    {
-      improv_command.command = ImprovTypes::Command::BAD_CHECKSUM;
-      return improv_command;
-    }
-  }
-
-  if (command == ImprovTypes::Command::WIFI_SETTINGS)
-  {
-    uint8_t ssid_length = data[2];
-    uint8_t ssid_start = 3;
-    size_t ssid_end = ssid_start + ssid_length;
-
-    uint8_t pass_length = data[ssid_end];
-    size_t pass_start = ssid_end + 1;
-    size_t pass_end = pass_start + pass_length;
-
-    std::string ssid(data + ssid_start, data + ssid_end);
-    std::string password(data + pass_start, data + pass_end);
-    return {.command = command, .ssid = ssid, .password = password};
-  }
-
-  improv_command.command = command;
-  return improv_command;
+  sendStatusFrame(ImprovTypes::TYPE_ERROR_STATE, error);
 }
 
-void ImprovWiFi::setState(ImprovTypes::State state)
+// State and error frames always have 11 bytes, they are built on the stack: a client polling
+// GET_CURRENT_STATE must not cause a heap allocation per frame.
+void ImprovWiFi::sendStatusFrame(ImprovTypes::ImprovSerialType type, uint8_t value)
 {
+  uint8_t data[11] = {'I', 'M', 'P', 'R', 'O', 'V', ImprovTypes::IMPROV_SERIAL_VERSION, type, 1, value, 0};
 
-  std::vector<uint8_t> data = {'I', 'M', 'P', 'R', 'O', 'V'};
-  data.resize(11);
-  data[6] = ImprovTypes::IMPROV_SERIAL_VERSION;
-  data[7] = ImprovTypes::TYPE_CURRENT_STATE;
-  data[8] = 1;
-  data[9] = state;
-
-  uint8_t checksum = 0x00;
-  for (uint8_t d : data)
-    checksum += d;
-  data[10] = checksum;
+  for (size_t i = 0; i < sizeof(data) - 1; i++)
+    data[sizeof(data) - 1] += data[i];
 
-  serial->write(data.data(), data.size());
+  serial->write(data, sizeof(data));
 }
 
-void ImprovWiFi::setError(ImprovTypes::Error error)
+void ImprovWiFi::sendResponse(std::vector<uint8_t> &response)
 {
-  std::vector<uint8_t> data = {'I', 'M', 'P', 'R', 'O', 'V'};
-  data.resize(11);
-  data[6] = ImprovTypes::IMPROV_SERIAL_VERSION;
-  data[7] = ImprovTypes::TYPE_ERROR_STATE;
-  data[8] = 1;
-  data[9] = error;
-
-  uint8_t checksum = 0x00;
-  for (uint8_t d : data)
-    checksum += d;
-  data[10] = checksum;
-
+  std::vector<uint8_t> data = build_frame(ImprovTypes::TYPE_RPC_RESPONSE, response);
   serial->write(data.data(), data.size());
 }
 
-void ImprovWiFi::sendResponse(std::vector<uint8_t> &response)
+std::vector<uint8_t> ImprovWiFi::build_frame(ImprovTypes::ImprovSerialType type, const std::vector<uint8_t> &payload)
 {
   std::vector<uint8_t> data = {'I', 'M', 'P', 'R', 'O', 'V'};
+  data.reserve(9 + payload.size() + 1);
   data.resize(9);
   data[6] = ImprovTypes::IMPROV_SERIAL_VERSION;
-  data[7] = ImprovTypes::TYPE_RPC_RESPONSE;
-  data[8] = response.size();
-  data.insert(data.end(), response.begin(), response.end());
+  data[7] = type;
+  data[8] = payload.size();
+  data.insert(data.end(), payload.begin(), payload.end());
 
   uint8_t checksum = 0x00;
   for (uint8_t d : data)
     checksum += d;
   data.push_back(checksum);
 
-  serial->write(data.data(), data.size());
+  return data;
 }
 
 std::vector<uint8_t> ImprovWiFi::build_rpc_response(ImprovTypes::Command command, const std::vector<std::string> &datum, bool add_checksum)
@@ -636,25 +1484,169 @@ std::vector<uint8_t> ImprovWiFi::build_rpc_response(ImprovTypes::Command command
   return out;
 }
 
-#ifdef ESP32
+void ImprovWiFi::acceptCredentials(std::string &ssid, std::string &password) {
+  // reconnects use the new credentials right away, whether or when they reach the flash
+  this->WifiCredentialsAvailable = true;
+  this->SSID = ssid.c_str();
+  this->PASSWORD = password.c_str();
+
+  if (this->writeBehind) {
+    // saved by the next loop(), after the host got its answer
+    this->pendingSsid = ssid;
+    this->pendingPassword = password;
+    this->persistStatus = ImprovTypes::PERSIST_PENDING;
+  } else {
+    this->persistCredentials(&ssid, &password);
+  }
+}
+
+bool ImprovWiFi::persistCredentials(std::string *ssid, std::string *password) {
+  bool saved;
+  if (customWiFiCredentialSavingCallback) {
+    saved = customWiFiCredentialSavingCallback(ssid, password);
+  } else {
+    saved = this->saveWiFiCredentials(ssid, password);
+  }
+  this->persistStatus = saved ? ImprovTypes::PERSIST_DONE : ImprovTypes::PERSIST_FAILED;
+  return saved;
+}
+
+void ImprovWiFi::checkPersistence() {
+  if (this->persistStatus != ImprovTypes::PERSIST_PENDING) {
+    return;
+  }
+
+  bool saved = this->persistCredentials(&this->pendingSsid, &this->pendingPassword);
+  std::fill(this->pendingPassword.begin(), this->pendingPassword.end(), 0);
+  this->pendingSsid.clear();
+  this->pendingPassword.clear();
+
+  if (!saved && !onImprovErrorCallbacks.empty()) {
+    for (auto &cb : onImprovErrorCallbacks) {
+      cb(ImprovTypes::ERROR_CREDENTIALS_NOT_SAVED);
+    }
+  }
+}
+
+uint32_t ImprovWiFi::checksumRecord(const ImprovTypes::CredentialRecord &record) {
+  // CRC-32 (IEEE), bitwise: it runs once per save or load
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(&record);
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < offsetof(ImprovTypes::CredentialRecord, crc); i++) {
+    crc ^= data[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+bool ImprovWiFi::loadCredentialRecord(ImprovTypes::CredentialRecord &record) {
+  ImprovTypes::CredentialRecord slot;
+  bool found = false;
+
+  for (uint8_t i = 0; i < 2; i++) {
+    if (!this->readCredentialSlot(i, slot) ||
+        slot.magic != ImprovTypes::CREDENTIAL_MAGIC ||
+        slot.crc != checksumRecord(slot)) {
+      continue;
+    }
+    // serial number arithmetic, the sequence may wrap
+    if (!found || (int32_t)(slot.sequence - record.sequence) > 0) {
+      record = slot;
+      found = true;
+    }
+  }
+  return found;
+}
+
 bool ImprovWiFi::saveWiFiCredentials(std::string* ssid, std::string* password) {
-  if (preferences.begin("wifi", false)) {
-    preferences.putString("ssid", ssid->c_str());
-    preferences.putString("password", password->c_str());
-    preferences.end();
-    Serial.println("WiFi credentials saved to NVS");
+  ImprovTypes::CredentialRecord record;
+  memset(&record, 0, sizeof(record));
+
+  if (ssid->length() >= sizeof(record.ssid) || password->length() >= sizeof(record.password)) {
+    Serial.println(F("WiFi credentials too long to save"));
+    return false;
+  }
+
+  ImprovTypes::CredentialRecord current;
+  uint32_t sequence = this->loadCredentialRecord(current) ? current.sequence + 1 : 1;
+
+  record.magic = ImprovTypes::CREDENTIAL_MAGIC;
+  record.sequence = sequence;
+  memcpy(record.ssid, ssid->data(), ssid->length());
+  memcpy(record.password, password->data(), password->length());
+  record.crc = checksumRecord(record);
+
+  // the slot of the current record is not touched: the new record only counts once it reads back complete,
+  // from then on its sequence number makes it win over the old one
+  uint8_t slot = sequence & 1;
+  ImprovTypes::CredentialRecord check;
+  bool saved = this->writeCredentialSlot(slot, record) &&
+               this->readCredentialSlot(slot, check) &&
+               memcmp(&check, &record, sizeof(record)) == 0;
+  memset(&record, 0, sizeof(record));
+  memset(&check, 0, sizeof(check));
+
+  if (!saved) {
+    Serial.println(F("Failed to save WiFi credentials"));
+    return false;
+  }
+
+  // the old layout is removed only now that the record is safe
+  this->clearLegacyWiFiCredentials();
+  Serial.println(F("WiFi credentials saved"));
+  return true;
+}
+
+bool ImprovWiFi::loadWiFiCredentials(String &ssid, String &password) {
+  ImprovTypes::CredentialRecord record;
+  if (this->loadCredentialRecord(record)) {
+    ssid = record.ssid;
+    password = record.password;
+    memset(&record, 0, sizeof(record));
+    Serial.println(F("WiFi credentials loaded"));
     this->WifiCredentialsAvailable = true;
-    this->SSID = ssid->c_str();
-    this->PASSWORD = password->c_str();
     return true;
-  } else {
+  }
+
+  // stored by an older version, moved into a record by the next save
+  return this->loadLegacyWiFiCredentials(ssid, password);
+}
+
+#ifdef ESP32
+bool ImprovWiFi::readCredentialSlot(uint8_t slot, ImprovTypes::CredentialRecord &record) {
+  if (!preferences.begin("wifi", true)) {
+    return false;
+  }
+  bool result = preferences.getBytes(slot ? "cred1" : "cred0", &record, sizeof(record)) == sizeof(record);
+  preferences.end();
+  return result;
+}
+
+bool ImprovWiFi::writeCredentialSlot(uint8_t slot, const ImprovTypes::CredentialRecord &record) {
+  if (!preferences.begin("wifi", false)) {
     Serial.println("Failed to open NVS");
-    this->WifiCredentialsAvailable = false;
     return false;
   }
+  bool result = preferences.putBytes(slot ? "cred1" : "cred0", &record, sizeof(record)) == sizeof(record);
+  preferences.end();
+  return result;
 }
 
-bool ImprovWiFi::loadWiFiCredentials(String &ssid, String &password) {
+void ImprovWiFi::clearLegacyWiFiCredentials() {
+  if (preferences.begin("wifi", false)) {
+    if (preferences.isKey("ssid")) {
+      preferences.remove("ssid");
+    }
+    if (preferences.isKey("password")) {
+      preferences.remove("password");
+    }
+    preferences.end();
+  }
+}
+
+bool ImprovWiFi::loadLegacyWiFiCredentials(String &ssid, String &password) {
   if (preferences.begin("wifi", true)) {
       ssid = preferences.getString("ssid", "");
       password = preferences.getString("password", "");
@@ -669,36 +1661,110 @@ bool ImprovWiFi::loadWiFiCredentials(String &ssid, String &password) {
   }
 }
 
-#else
+bool ImprovWiFi::saveLease(const ImprovTypes::DhcpLease &lease) {
+  if (!preferences.begin("wifi", false)) {
+    return false;
+  }
+  bool result = preferences.putBytes("lease", &lease, sizeof(lease)) == sizeof(lease);
+  preferences.end();
+  return result;
+}
 
-bool ImprovWiFi::saveWiFiCredentials(std::string* ssid, std::string* password) {
-  EEPROM.begin(WIFI_SSID_LENGTH + WIFI_PASSWORD_LENGTH);
-  
-  // make sure the EEPROM is clean
-  for (size_t i = 0; i < WIFI_SSID_LENGTH + WIFI_PASSWORD_LENGTH ; i++) {
-    EEPROM.write(i, 0xFF);
+bool ImprovWiFi::loadLease(ImprovTypes::DhcpLease &lease) {
+  if (!preferences.begin("wifi", true)) {
+    return false;
   }
-  
-  // save the SSID
-  for (size_t i = 0; i < ssid->length(); i++) {
-    EEPROM.write(i, ssid->c_str()[i]);
+  bool result = preferences.getBytes("lease", &lease, sizeof(lease)) == sizeof(lease);
+  preferences.end();
+  return result;
+}
+
+#else
+
+bool ImprovWiFi::mountFileSystem() {
+  if (!this->fileSystemChecked) {
+    this->fileSystemChecked = true;
+    // never format, the partition may hold the data of the application
+    LittleFSConfig config;
+    config.setAutoFormat(false);
+    LittleFS.setConfig(config);
+    this->fileSystemMounted = LittleFS.begin();
+    if (!this->fileSystemMounted) {
+      Serial.println(F("No LittleFS, WiFi credentials are kept in the EEPROM sector"));
+    }
   }
-  EEPROM.write(ssid->length(), 0); // null-terminate the string
+  return this->fileSystemMounted;
+}
 
-  // save the password
-  for (size_t i = 0; i < password->length(); i++) {
-    EEPROM.write(WIFI_SSID_LENGTH + i, password->c_str()[i]);
+bool ImprovWiFi::writeFile(const char *path, const void *data, size_t length) {
+  // LittleFS commits a file on close and renames atomically: the target holds either the old or the new data
+  char temp[32];
+  snprintf(temp, sizeof(temp), "%s.tmp", path);
+
+  File file = LittleFS.open(temp, "w");
+  if (!file) {
+    return false;
   }
-  EEPROM.write(WIFI_SSID_LENGTH + password->length(), 0); // null-terminate the string
+  bool written = file.write((const uint8_t *)data, length) == length;
+  file.close();
+  return written && LittleFS.rename(temp, path);
+}
 
-  EEPROM.commit();
-  EEPROM.end(); 
+bool ImprovWiFi::readCredentialSlot(uint8_t slot, ImprovTypes::CredentialRecord &record) {
+  if (this->mountFileSystem()) {
+    File file = LittleFS.open(slot ? "/improv.cred1" : "/improv.cred0", "r");
+    if (!file) {
+      return false;
+    }
+    bool result = file.read((uint8_t *)&record, sizeof(record)) == sizeof(record);
+    file.close();
+    return result;
+  }
 
-  Serial.println("WiFi credentials saved to EEPROM successfully.");
+  EEPROM.begin(WIFI_EEPROM_SIZE);
+  EEPROM.get(WIFI_CREDENTIAL_OFFSET + slot * sizeof(record), record);
+  EEPROM.end();
   return true;
 }
 
-bool ImprovWiFi::loadWiFiCredentials(String &ssid, String &password) {
+bool ImprovWiFi::writeCredentialSlot(uint8_t slot, const ImprovTypes::CredentialRecord &record) {
+  if (this->mountFileSystem()) {
+    return this->writeFile(slot ? "/improv.cred1" : "/improv.cred0", &record, sizeof(record));
+  }
+
+  EEPROM.begin(WIFI_EEPROM_SIZE);
+  EEPROM.put(WIFI_CREDENTIAL_OFFSET + slot * sizeof(record), record);
+  // the old layout goes with the same commit, every commit erases the sector
+  for (size_t i = 0; i < WIFI_SSID_LENGTH + WIFI_PASSWORD_LENGTH; i++) {
+    EEPROM.write(i, 0xFF);
+  }
+  bool result = EEPROM.commit();
+  EEPROM.end();
+  return result;
+}
+
+void ImprovWiFi::clearLegacyWiFiCredentials() {
+  // without LittleFS the old layout was cleared by the commit of the record
+  if (!this->mountFileSystem()) {
+    return;
+  }
+
+  EEPROM.begin(WIFI_EEPROM_SIZE);
+  bool dirty = false;
+  for (size_t i = 0; i < WIFI_SSID_LENGTH + WIFI_PASSWORD_LENGTH; i++) {
+    if (EEPROM.read(i) != 0xFF) {
+      EEPROM.write(i, 0xFF);
+      dirty = true;
+    }
+  }
+  // the sector is only erased once, when an old layout is found
+  if (dirty) {
+    EEPROM.commit();
+  }
+  EEPROM.end();
+}
+
+bool ImprovWiFi::loadLegacyWiFiCredentials(String &ssid, String &password) {
     char myssid[WIFI_SSID_LENGTH];
     char mypassword[WIFI_PASSWORD_LENGTH];
     bool result = false;
@@ -706,14 +1772,23 @@ bool ImprovWiFi::loadWiFiCredentials(String &ssid, String &password) {
     // Inline-Funktion zur Überprüfung der Gültigkeit von Credentials
     auto isValidCredential = [](const char* credential, size_t length) -> bool {
       for (size_t i = 0; i < length; i++) {
-        if (credential[i] != 0xFF) {
+        if ((uint8_t)credential[i] != 0xFF) {
           return true;
         }
       }
       return false;
     };
 
-    EEPROM.begin(WIFI_SSID_LENGTH + WIFI_PASSWORD_LENGTH);
+    // a field filled completely has no terminating NUL
+    auto toString = [](const char* credential, size_t length) -> String {
+      char terminated[WIFI_PASSWORD_LENGTH + 1];
+      size_t used = strnlen(credential, length);
+      memcpy(terminated, credential, used);
+      terminated[used] = '\0';
+      return String(terminated);
+    };
+
+    EEPROM.begin(WIFI_EEPROM_SIZE);
     EEPROM.get(0, myssid);
     EEPROM.get(32, mypassword);
     EEPROM.end();
@@ -721,8 +1796,8 @@ bool ImprovWiFi::loadWiFiCredentials(String &ssid, String &password) {
     if (isValidCredential(myssid, WIFI_SSID_LENGTH) && isValidCredential(mypassword, WIFI_PASSWORD_LENGTH)) {
       Serial.println("WiFi credentials loaded from EEPROM successfully.");
       //Serial.printf("SSID: %s, Password: %s\n", myssid, mypassword);
-      ssid = String(myssid);
-      password = String(mypassword);
+      ssid = toString(myssid, WIFI_SSID_LENGTH);
+      password = toString(mypassword, WIFI_PASSWORD_LENGTH);
 
       result = true;
     } else {
@@ -732,4 +1807,26 @@ bool ImprovWiFi::loadWiFiCredentials(String &ssid, String &password) {
     return result;
 }
 
+bool ImprovWiFi::saveLease(const ImprovTypes::DhcpLease &lease) {
+  // never commit the EEPROM sector of the credentials for a lease, without LittleFS it is only kept in RAM
+  if (!this->mountFileSystem()) {
+    return true;
+  }
+  return this->writeFile("/improv.lease", &lease, sizeof(lease));
+}
+
+bool ImprovWiFi::loadLease(ImprovTypes::DhcpLease &lease) {
+  if (!this->mountFileSystem()) {
+    return false;
+  }
+
+  File file = LittleFS.open("/improv.lease", "r");
+  if (!file) {
+    return false;
+  }
+  bool result = file.read((uint8_t *)&lease, sizeof(lease)) == sizeof(lease);
+  file.close();
+  return result && lease.version == ImprovTypes::LEASE_VERSION;
+}
+
 #endif
\ No newline at end of file
@@ -4,12 +4,80 @@
 #define IMPROV_RUN_FOR 60000
 #endif
 
+// time ConnectToWifi() waits for an association after each WiFi.begin()
+#ifndef IMPROV_CONNECT_TIMEOUT_MS
+#define IMPROV_CONNECT_TIMEOUT_MS 5000
+#endif
+
+// pause between two reconnect attempts of ConnectToWifi()
+#ifndef IMPROV_RECONNECT_INTERVAL_MS
+#define IMPROV_RECONNECT_INTERVAL_MS 30000
+#endif
+
+// time the client has to talk at a newly negotiated baud rate before the old one is restored
+#ifndef IMPROV_BAUD_CONFIRM_MS
+#define IMPROV_BAUD_CONFIRM_MS 2000
+#endif
+
+// dwell time per channel of a targeted scan (ESP32 only, ESP8266 uses the SDK default)
+#ifndef IMPROV_SCAN_MS_PER_CHANNEL
+#define IMPROV_SCAN_MS_PER_CHANNEL 120
+#endif
+
+// interval of the RSSI samples taken by the link-quality monitor
+#ifndef IMPROV_RSSI_SAMPLE_MS
+#define IMPROV_RSSI_SAMPLE_MS 1000
+#endif
+
+// minimum time between two roaming scans of the link-quality monitor
+#ifndef IMPROV_ROAM_HOLDOFF_MS
+#define IMPROV_ROAM_HOLDOFF_MS 60000
+#endif
+
+// time after connecting with a cached lease until its address and gateway are probed with ARP
+#ifndef IMPROV_LEASE_VALIDATE_DELAY_MS
+#define IMPROV_LEASE_VALIDATE_DELAY_MS 10000
+#endif
+
+// time the gateway has to answer the ARP probe, and DHCP to replace a lease which failed it
+#ifndef IMPROV_LEASE_VALIDATE_TIMEOUT_MS
+#define IMPROV_LEASE_VALIDATE_TIMEOUT_MS 5000
+#endif
+
+// longest time a cached lease is used before DHCP takes over, also if its lease time is unknown
+#ifndef IMPROV_LEASE_RENEW_MAX_MS
+#define IMPROV_LEASE_RENEW_MAX_MS 3600000
+#endif
+
+// check WIFI_SETTINGS against the last scan (or a targeted probe) before trying to connect
+#ifndef IMPROV_VALIDATE_WIFI_SETTINGS
+#define IMPROV_VALIDATE_WIFI_SETTINGS 1
+#endif
+
+// age up to which the result of GET_WIFI_NETWORKS is used to validate WIFI_SETTINGS
+#ifndef IMPROV_SCAN_CACHE_MS
+#define IMPROV_SCAN_CACHE_MS 60000
+#endif
+
+// longest wake sequence accepted by setWakeSequence()
+#ifndef IMPROV_WAKE_SEQUENCE_MAX
+#define IMPROV_WAKE_SEQUENCE_MAX 16
+#endif
+
+// reconnect attempts before ERROR_WIFI_CONNECT_GIVEUP is raised
+#ifndef IMPROV_MAX_CONNECT_RETRIES
+#define IMPROV_MAX_CONNECT_RETRIES 30
+#endif
+
 #if defined(ARDUINO_ARCH_ESP8266)
   #include <ESP8266WiFi.h>
   #include <EEPROM.h>
+  #include <LittleFS.h>
   #define WIFI_OPEN ENC_TYPE_NONE 
   #define WIFI_SSID_LENGTH 32
   #define WIFI_PASSWORD_LENGTH 64
+  #define WIFI_CREDENTIAL_OFFSET (WIFI_SSID_LENGTH + WIFI_PASSWORD_LENGTH)
+  #define WIFI_EEPROM_SIZE (WIFI_CREDENTIAL_OFFSET + 2 * sizeof(ImprovTypes::CredentialRecord))
 #elif defined(ARDUINO_ARCH_ESP32)
   #include <Preferences.h>
   #include <WiFi.h>
@@ -18,6 +86,11 @@
 
 #include <Stream.h>
 #include "ImprovTypes.h"
+#include "ImprovFrameAssembler.h"
+#include "ImprovRpcDecoder.h"
+#include "ImprovResponseEncoder.h"
+#include "ImprovClock.h"
+#include <algorithm>
 #include <functional>
 #include <vector>
 
@@ -25,6 +98,9 @@
   #include <Arduino.h>
 #endif
 
+// Handler of an RPC command, see ImprovWiFi::registerRpcHandler()
+typedef std::function<bool(const ImprovTypes::ImprovCommandView &cmd, ImprovResponseEncoder &response)> ImprovRpcHandler;
+
 /**
  * Improv WiFi class
  *
@@ -35,13 +111,26 @@
  */
 class ImprovWiFi
 {
+  // host benchmarks, see test/bench.cpp
+  friend struct ImprovWiFiBenchAccess;
+
 private:
   const char *const CHIP_FAMILY_DESC[5] = {"ESP32", "ESP32-C3", "ESP32-S2", "ESP32-S3", "ESP8266"};
   ImprovTypes::ImprovWiFiParamsStruct improvWiFiParams;
 
-  uint8_t  _buffer[128];
-  uint8_t  _position = 0;
-  uint32_t _stopme   = 0;
+  ImprovFrameAssembler frame;
+  ImprovClock *clock;
+
+  // RPC dispatch: rpcIndex maps a command byte to 1 + its position in rpcHandlers, 0 if unknown
+  uint8_t   rpcIndex[256] = {0};
+  std::vector<ImprovRpcHandler> rpcHandlers;
+  uint64_t _stopme   = 0;
+
+  // dormant mode: after IMPROV_RUN_FOR only the wake sequence is searched for
+  uint8_t  wakeSequence[IMPROV_WAKE_SEQUENCE_MAX] = {'I', 'M', 'P', 'R', 'O', 'V'};
+  uint8_t  wakeSequenceLength = 6;
+  bool     customWakeSequence = false;
+  uint8_t  wakeMatched        = 0;
   String    SSID     = "";
   String    PASSWORD = "";
 
@@ -50,32 +139,147 @@ private:
   bool      connectFailure;
   uint8_t  maxConnectRetries;
   uint8_t  numConnectRetriesDone;
-  uint32_t  millisLastConnectTry;
+  uint64_t  millisLastConnectTry;
   bool      lastConnectStatus;
   bool      WifiCredentialsAvailable = false;
   bool      WifiDeviceIsLocked = false; // to avoid multiple calls of starting wifi connection in the same time (reconnect vs. getAvailableNetworks)
   uint8_t   BSSID[6] = {0};
+  uint8_t   lastChannel = 0;        // channel the saved network was last seen on, 0 if unknown
+
+  // networks of the last GET_WIFI_NETWORKS scan
+  struct ScannedNetwork {
+    uint32_t ssidHash;
+    bool     open;
+    uint8_t  channel;
+  };
+  std::vector<ScannedNetwork> scanCache;
+  uint64_t  millisLastScan      = 0;
+  volatile uint8_t disconnectReason = 0;  // written by the WiFi event task (ESP32)
+
+  bool      roamingEnabled      = false;
+  bool      roaming             = false;  // re-association to a stronger AP in progress
+  int8_t    roamThreshold       = 0;
+  uint8_t   roamHysteresis      = 0;
+  int32_t   rssiAverage         = 0;      // EWMA of the RSSI in 1/16 dBm
+  uint8_t   rssiSamples         = 0;
+  uint64_t  millisLastRssiSample = 0;
+  uint64_t  millisLastRoam      = 0;
+  uint16_t  knownChannels       = 0;      // bit n set: the saved network was seen on channel n
+  uint16_t  settingsChannels    = 0;      // the same for the network of WIFI_SETTINGS while it is validated
+  uint8_t   roamScanChannel     = 0;      // channel of the running roaming scan, 0 if none
+  bool      roamCandidateFound  = false;
+  ImprovTypes::NetworkInfo roamCandidate = {};
+  static const uint8_t ROAM_SCAN_ALL_CHANNELS = 0xFF;
+
+  bool      leaseCacheEnabled   = false;
+  bool      leaseLoaded         = false;
+  bool      leaseApplied        = false;  // interface configured from the cached lease
+  enum LeaseCheck : uint8_t {
+    LEASE_CHECK_WAIT,                     // connected with the cached lease, nothing sent yet
+    LEASE_CHECK_ARP,                      // own address announced, gateway asked for
+    LEASE_CHECK_READ,                     // waiting for the ARP table
+    LEASE_CHECK_RENEW,                    // lease passed the probe, DHCP takes over before it expires
+    LEASE_CHECK_DHCP,                     // lease failed the probe or is due, back to DHCP
+    LEASE_CHECK_DONE,
+  };
+  LeaseCheck leaseCheck         = LEASE_CHECK_DONE;
+  volatile bool leaseProbeDone  = false;  // set from the lwIP thread on ESP32
+  volatile bool leaseGatewayFound = false;
+  volatile bool leaseConflict   = false;
+  volatile bool leaseTimeRead   = false;
+  volatile uint32_t leaseTimeSeconds = 0;
+  bool      leaseStorePending   = false;  // lease is saved once its lease time was read
+  uint64_t  millisLeaseValidate = 0;
+  uint64_t  millisLeaseApplied  = 0;      // connected with the cached lease
+  ImprovTypes::DhcpLease lease  = {};
+
+  bool      writeBehind         = false;
+  ImprovTypes::PersistStatus persistStatus = ImprovTypes::PERSIST_IDLE;
+  std::string pendingSsid;
+  std::string pendingPassword;
+
+  uint32_t  baudRate            = 0;   // 0: baud rate negotiation disabled
+  uint32_t  maxBaudRate         = 0;
+  uint32_t  previousBaudRate    = 0;
+  uint64_t  millisBaudRateSwitch = 0;
+  bool      baudRatePending     = false;
+
+  // fully encoded response frames, rebuilt only when their inputs change
+  std::vector<uint8_t>  deviceInfoFrame;
+  std::vector<uint8_t>  deviceUrlFrame;
+  uint32_t              deviceUrlFrameIp  = 0;
+  ImprovTypes::Command  deviceUrlFrameCmd = ImprovTypes::Command::UNKNOWN;
 
   void sendDeviceUrl(ImprovTypes::Command cmd);
-  bool onCommandCallback(ImprovTypes::ImprovCommand cmd);
+  bool onCommandCallback(const ImprovTypes::ImprovCommandView &cmd);
+  void registerBuiltinRpcHandlers();
+  bool rpcGetCurrentState(const ImprovTypes::ImprovCommandView &cmd);
+  bool rpcWiFiSettings(const ImprovTypes::ImprovCommandView &cmd);
+  bool rpcGetDeviceInfo(const ImprovTypes::ImprovCommandView &cmd);
+  bool rpcGetWiFiNetworks(const ImprovTypes::ImprovCommandView &cmd);
+  bool rpcSetBaudRate(const ImprovTypes::ImprovCommandView &cmd);
   void onErrorCallback(ImprovTypes::Error err);
   void setState(ImprovTypes::State state);
+  void sendStatusFrame(ImprovTypes::ImprovSerialType type, uint8_t value);
   void sendResponse(std::vector<uint8_t> &response);
+  void sendDeviceInfo();
+  void invalidateResponseCache();
   void setError(ImprovTypes::Error error);
-  void getAvailableWifiNetworks();
+  void getAvailableWifiNetworks(bool compact = false);
+  void sendCompactNetworkList(const int *indices, uint16_t networkNum);
+  static ImprovTypes::NetworkAuth networkAuth(int encryptionType);
+  bool scanForSavedNetwork(ImprovTypes::NetworkInfo &result);
+  bool validateWiFiSettings(const char *ssid, const char *password);
+  bool isAuthFailure();
+  static uint32_t hashSsid(const char *ssid, size_t length);
+  void checkLinkQuality();
+  void pollRoamScan();
+  void finishRoamScan();
+  uint8_t nextKnownChannel(uint8_t channel);
+  static uint16_t channelBit(int32_t channel);
+  int16_t startScan(const char *ssid, uint8_t channel, bool async);
+  bool pickStrongest(const char *ssid, int16_t networkNum, ImprovTypes::NetworkInfo &result, bool found);
+  void loadCachedLease();
+  void applyCachedLease(const uint8_t *bssid);
+  void storeCurrentLease();
+  void checkLeaseStore();
+  void checkLease();
+  uint64_t leaseRenewMs();
+  static void sendLeaseProbe(void *arg);
+  static void readLeaseProbe(void *arg);
+  static void readLeaseTime(void *arg);
+  bool saveLease(const ImprovTypes::DhcpLease &lease);
+  bool loadLease(ImprovTypes::DhcpLease &lease);
+  bool switchBaudRate(const ImprovTypes::ImprovCommandView &cmd);
+  void checkBaudRateTimeout();
   inline void replaceAll(std::string &str, const std::string &from, const std::string &to);
+  void acceptCredentials(std::string &ssid, std::string &password);
+  bool persistCredentials(std::string *ssid, std::string *password);
+  void checkPersistence();
   bool saveWiFiCredentials(std::string* ssid, std::string* password);
   bool loadWiFiCredentials(String &ssid, String &password);
+  bool loadCredentialRecord(ImprovTypes::CredentialRecord &record);
+  bool readCredentialSlot(uint8_t slot, ImprovTypes::CredentialRecord &record);
+  bool writeCredentialSlot(uint8_t slot, const ImprovTypes::CredentialRecord &record);
+  bool loadLegacyWiFiCredentials(String &ssid, String &password);
+  void clearLegacyWiFiCredentials();
+  static uint32_t checksumRecord(const ImprovTypes::CredentialRecord &record);
   void checkSerial();
+  bool handleBytes(const uint8_t *data, size_t length);
+  size_t detectWake(const uint8_t *data, size_t length);
   
   // improv SDK
-  bool parseImprovSerial(size_t position, uint8_t byte, const uint8_t *buffer);
-  ImprovTypes::ImprovCommand parseImprovData(const std::vector<uint8_t> &data, bool check_checksum = true);
-  ImprovTypes::ImprovCommand parseImprovData(const uint8_t *data, size_t length, bool check_checksum = true);
+  bool parseImprovSerial(uint8_t byte);
   std::vector<uint8_t> build_rpc_response(ImprovTypes::Command command, const std::vector<std::string> &datum, bool add_checksum);
+  std::vector<uint8_t> build_frame(ImprovTypes::ImprovSerialType type, const std::vector<uint8_t> &payload);
 
   #ifdef ESP32
     Preferences preferences;
+  #else
+    bool fileSystemChecked = false;
+    bool fileSystemMounted = false;   // credentials in LittleFS files, otherwise in the EEPROM sector
+    bool mountFileSystem();
+    bool writeFile(const char *path, const void *data, size_t length);
   #endif
 
 public:
@@ -116,6 +320,21 @@ public:
   }
   std::vector<std::function<void(const char *ssid, const char *password)>> onImprovConnectedCallbacks;
 
+  /**
+  * @brief     Callback functions called when new credentials were accepted, over WIFI_SETTINGS or `provision()`.
+  *            Unlike `onImprovConnected` not called for reconnects. Multiple callbacks can be set.
+  *
+  * @param     ssid  wifi ssid
+  * @param     password  wifi password
+  *
+  * @return
+  *    - none
+  */
+  void onImprovProvisioned(std::function<void(const char *ssid, const char *password)> cb) {
+    onImprovProvisionedCallbacks.push_back(cb);
+  }
+  std::vector<std::function<void(const char *ssid, const char *password)>> onImprovProvisionedCallbacks;
+
   /**
   * @brief     Callback function to customize the wifi connection if you needed. Optional.
   *  
@@ -167,6 +386,28 @@ public:
   std::function<bool(String &ssid, String &password)> customWiFiCredentialLoadingCallback;
 
 
+  /**
+  * @brief     Allow the client to move the serial line to a faster baud rate with the vendor RPC `SET_BAUD_RATE`. Optional.
+  *   The RPC carries the requested rate as a decimal string. It is acknowledged at the current rate, then the port is switched.
+  *   If no valid frame arrives at the new rate within `IMPROV_BAUD_CONFIRM_MS` (default 2000), the previous rate is restored,
+  *   also while `ConnectToWifi()` blocks. Rates below the current one or above `maxBaud` are rejected with `ERROR_INVALID_RPC`.
+  *   If `cb` returns false, `ERROR_UNKNOWN` is sent after the acknowledgement and the previous rate is restored at once.
+  *
+  * @param     currentBaud  baud rate the serial port runs at
+  * @param     maxBaud  highest baud rate a client may request
+  * @param     cb  function reconfiguring the serial port, e.g. `[](uint32_t baud) { Serial.updateBaudRate(baud); return true; }`
+  *
+  * @return
+  *    - none
+  */
+  void setBaudRateSwitching(uint32_t currentBaud, uint32_t maxBaud, std::function<bool(uint32_t baud)> cb) {
+    baudRate = currentBaud;
+    maxBaudRate = maxBaud;
+    baudRateSwitchCallback = cb;
+  }
+  std::function<bool(uint32_t baud)> baudRateSwitchCallback;
+
+
   /**
   * @brief     Check if a communication via serial is happening. It handles also wifi reconnection.
   *            Put this call on your loop().
@@ -176,8 +417,35 @@ public:
   */
   void loop();
 
+  /**
+  * @brief     Feed data received on another transport (e.g. a web socket) into the Improv parser.
+  *
+  * @return    
+  *   - bool  true if any byte belonged to an Improv frame
+  */
   bool handleBuffer(uint8_t *buffer, uint16_t bytes);
 
+  /**
+  * @brief     Replace the sequence which wakes the listener from dormant mode. Optional.
+  *   `IMPROV_RUN_FOR` milliseconds (default 60000) after the last Improv frame the listener goes dormant:
+  *   incoming data is only searched for the wake sequence instead of being parsed byte by byte.
+  *   By default the sequence is the Improv header `IMPROV`, so a client never notices the dormant state.
+  *   With a custom sequence, frames are only accepted after the client sent it.
+  *
+  * @param     sequence  wake sequence, up to `IMPROV_WAKE_SEQUENCE_MAX` (default 16) characters, `nullptr` restores the default
+  *
+  * @return
+  *    - none
+  */
+  void setWakeSequence(const char *sequence);
+
+  /**
+  * @brief     true while the listener waits for the wake sequence
+  */
+  bool isDormant() {
+    return clock->millis64() >= _stopme;
+  }
+
   
   /**
   * @brief     Set details of your device. It's used to inform the ImprovWiFi library about your device.
@@ -188,6 +456,7 @@ public:
   * @param     deviceName  Your device name
   * @param     deviceUrl  The local URL to access your device. A placeholder called {LOCAL_IPV4} is available to form elaboreted URLs. E.g. `http://{LOCAL_IPV4}?name=Guest`.
   *     There is overloaded method without `deviceUrl`, in this case the URL will be the local IP.  
+  *     The placeholder is resolved each time the IP address changes, the template itself is kept.
   *
   * @return    
   *   - none
@@ -200,6 +469,7 @@ public:
   * @brief     Default method to connect in a WiFi network.
   *   It waits `DELAY_MS_WAIT_WIFI_CONNECTION` milliseconds (default 500) during `MAX_ATTEMPTS_WIFI_CONNECTION` (default 20) until it get connected. 
   *   If it does not happen, an error `ERROR_UNABLE_TO_CONNECT` is thrown.
+  *   It gives up early if the network is not found or rejects the password.
   *  
   * @param     ssid  wifi ssid
   * @param     password  wifi password
@@ -213,6 +483,8 @@ public:
   /**
   * @brief     regular method to connect to wifi with present credentials.
   *   Use this method in your setup function to connect to wifi. Optional.
+  *   The first attempt goes straight to the AP and channel of the cached lease (see `enableLeaseCache`), or lets the
+  *   firmware find the network. Only the retries probe for the network first, see `scanForNetwork`.
   *  
   * @param     firstRun  true if it's the first time running the device
   *
@@ -226,6 +498,138 @@ public:
    */
   bool isConnected();
 
+  /**
+  * @brief     Connect with credentials received outside of the serial protocol, e.g. from a peer, and keep them.
+  *   Takes the same connect, save, `onImprovProvisioned` and `onImprovConnected` steps as WIFI_SETTINGS, without
+  *   the check against the last scan and without state frames on the serial line.
+  *
+  * @param     ssid  wifi ssid
+  * @param     password  wifi password
+  *
+  * @return
+  *   - bool  true if the connection was established and the credentials accepted
+  */
+  bool provision(const char *ssid, const char *password);
+
+  /**
+  * @brief     if credentials were loaded from the flash or accepted since the start
+  */
+  bool hasCredentials() {
+    return WifiCredentialsAvailable;
+  }
+
+  /**
+  * @brief     Scan for a single network instead of running a full scan, optionally restricted to some channels.
+  *   Only the strongest access point broadcasting the SSID is reported.
+  *
+  * @param     ssid  wifi ssid
+  * @param     result  channel, BSSID and RSSI of the strongest matching access point
+  * @param     channels  channels to probe, `nullptr` to probe all
+  * @param     channelCount  number of entries in `channels`
+  *
+  * @return
+  *   - bool  true if the network was found
+  */
+  bool scanForNetwork(const char *ssid, ImprovTypes::NetworkInfo &result, const uint8_t *channels = nullptr, uint8_t channelCount = 0);
+
+  /**
+  * @brief     Cache the DHCP lease for a fast reconnect. Optional.
+  *   The lease (IP, gateway, subnet, DNS) of the last connection is saved with the credentials, together with the BSSID
+  *   and channel of the AP, so the first connect after a boot needs no scan. When reconnecting to the
+  *   same BSSID the lease is applied with `WiFi.config()`, which skips the DHCP exchange. `IMPROV_LEASE_VALIDATE_DELAY_MS` later,
+  *   the address is announced with a gratuitous ARP and the gateway is asked for its MAC; the interface keeps its address
+  *   meanwhile. Only if the gateway does not answer or another host claims the address, the interface goes back to DHCP
+  *   and the new lease replaces the cached one.
+  *   The cached lease is never renewed with the DHCP server. Half its lease time after the connect, at most
+  *   `IMPROV_LEASE_RENEW_MAX_MS` (default 3600000), the interface goes back to DHCP as well, which drops the address
+  *   for the DHCP exchange. The time the device was off is unknown, a lease which expired meanwhile is only caught by the probe.
+  *   On ESP8266 the lease is kept in LittleFS, without a file system only in RAM, so it never causes a commit of the
+  *   EEPROM sector holding the credentials.
+  *
+  * @attention Only used if the credentials are stored by the library, not with `setCustomWiFiCredentialSaving`.
+  *
+  * @return
+  *    - none
+  */
+  void enableLeaseCache() {
+    leaseCacheEnabled = true;
+  }
+
+  /**
+  * @brief     Save the credentials of WIFI_SETTINGS after the response instead of before it. Optional.
+  *   By default the credentials are written before STATE_PROVISIONED and the device URL are sent, so the host waits
+  *   for the flash write (on ESP8266 a sector erase). With write-behind they are kept in RAM and written by the next `loop()`.
+  *   The library stores them in two alternating slots, each with a sequence number and a CRC; a record torn by a power
+  *   cut fails the check on load and the previous one is used. On ESP8266 the slots are LittleFS files, each written to
+  *   a temporary file which is then renamed over the slot.
+  *
+  * @attention On ESP8266 LittleFS is mounted without formatting. Without a LittleFS partition the slots fall back to the
+  *   EEPROM sector, whose erase covers both of them: a power cut during the save can then lose the credentials.
+  *   If the save fails, the error callbacks get `ERROR_CREDENTIALS_NOT_SAVED`.
+  *
+  * @param     enable  true to write the credentials from `loop()`
+  *
+  * @return
+  *    - none
+  */
+  void setWriteBehindPersistence(bool enable) {
+    writeBehind = enable;
+  }
+
+  /**
+  * @brief     State of the last credential save.
+  *
+  * @return
+  *    - ImprovTypes::PersistStatus  `PERSIST_PENDING` until `loop()` wrote the credentials of write-behind mode
+  */
+  ImprovTypes::PersistStatus getPersistStatus() {
+    return persistStatus;
+  }
+
+  /**
+  * @brief     Enable the link-quality monitor. Optional.
+  *   While connected, `loop()` samples the RSSI every `IMPROV_RSSI_SAMPLE_MS` (default 1000) into a moving average.
+  *   If the average drops below `threshold`, a background scan looks for a stronger AP of the same network and, if one is
+  *   at least `hysteresis` dB better, the device re-associates to it. Scans are at least `IMPROV_ROAM_HOLDOFF_MS` (default 60000) apart.
+  *   The scan only covers the channels the network was seen on (connects, probes, GET_WIFI_NETWORKS), all channels if
+  *   fewer than two are known; `loop()` polls it and never waits for it.
+  *
+  * @attention The new AP is stored with `setBSSID()` and replaces a BSSID set before.
+  *
+  * @param     threshold  average RSSI in dBm below which a better AP is searched, e.g. -75
+  * @param     hysteresis  dB a candidate has to be stronger than the current link, e.g. 8
+  *
+  * @return
+  *    - none
+  */
+  void enableRoaming(int8_t threshold, uint8_t hysteresis);
+
+  /**
+  * @brief     Handle an RPC command, e.g. a vendor command for diagnostics or factory tests. Optional.
+  *   Lookup is a single table access per frame. A handler registered for a built-in command (WIFI_SETTINGS,
+  *   GET_CURRENT_STATE, GET_DEVICE_INFO, GET_WIFI_NETWORKS, SET_BAUD_RATE) replaces it.
+  *   The handler gets a view of the decoded frame, valid only during the call, and an encoder for the response.
+  *   If the handler returns true, the strings added to it are sent as RPC response; without strings the empty response
+  *   acknowledges the command. `response.fail(error)` sends the error instead, strings which do not fit send `ERROR_UNKNOWN`.
+  *   If the handler returns false without an error, nothing is sent.
+  *
+  * @attention Vendor commands should use values from 0xF1 on, standard clients ignore them. 0x00 and 0xFF cannot be registered.
+  *
+  * @param     command  command byte of the RPC
+  * @param     handler  returns true if the command succeeded, nullptr to remove the handler
+  *
+  * @return
+  *   - bool  false if `command` is reserved
+  */
+  bool registerRpcHandler(uint8_t command, ImprovRpcHandler handler);
+
+  /**
+   * @brief     Replace the time source of the library, e.g. by an `ImprovVirtualClock` for simulations.
+   *   By default the 64-bit system timer and `delay()` are used.
+   * @param     clock  clock to use, has to outlive this instance
+   */
+  void setClock(ImprovClock *clock);
+
   /**
    * @brief     set a specific Accesspoint MAC address for binding WLAN Connection this this AP
    * @param     mac  uint8_t[] of MAC address of the Accesspoint
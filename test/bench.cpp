@@ -0,0 +1,462 @@
+// Host benchmarks of the library hot paths: framing and dispatch, response encoding, scan
+// post-processing, credential storage and the idle loop().
+//
+//   bench [filter] [--baud B] [--json]
+//
+// Built as `bench` against the ESP32 and as `bench_esp8266` against the ESP8266 stand-ins. Every case
+// runs until it took at least 200 ms. The text output lists ns per operation and, for cases processing
+// bytes, the throughput; --json prints the same as one JSON document for tracking between releases.
+// Radio and flash take no time on the host, the numbers are the cost of the library itself.
+// The scan cases also send one request over a simulated serial line at --baud (default 115200) and
+// report the bytes on the wire and the session time on the virtual clock, scan included.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "FakeDevice.h"
+#include "FakeSerial.h"
+#include "ImprovFrameAssembler.h"
+#include "ImprovHost.h"
+#include "ImprovRpcDecoder.h"
+#include "ImprovWiFiLibrary.h"
+
+#if defined(ARDUINO_ARCH_ESP8266)
+static const char *PLATFORM = "esp8266";
+#else
+static const char *PLATFORM = "esp32";
+#endif
+
+static uint32_t serialBaud = 115200;
+
+struct BenchState
+{
+  uint64_t iterations;
+  uint64_t bytes = 0;             // processed per operation, for the throughput
+  uint64_t opsPerIteration = 1;   // operations (e.g. frames) per iteration
+  uint64_t wireBytes = 0;         // sent to the host per operation, for cases measured on the serial line
+  uint64_t sessionMs = 0;         // virtual time of one operation on the serial line
+  std::chrono::steady_clock::time_point start;
+
+  // excludes the setup of a case from its time
+  void resetTimer() { start = std::chrono::steady_clock::now(); }
+};
+
+struct BenchCase
+{
+  const char *name;
+  std::function<void(BenchState &)> run;
+};
+
+static std::vector<BenchCase> &cases()
+{
+  static std::vector<BenchCase> all;
+  return all;
+}
+
+struct BenchRegistration
+{
+  BenchRegistration(const char *name, std::function<void(BenchState &)> run) { cases().push_back({name, run}); }
+};
+
+#define BENCH(name)                                               \
+  static void bench_##name(BenchState &state);                     \
+  static BenchRegistration bench_##name##_registration(#name, bench_##name); \
+  static void bench_##name(BenchState &state)
+
+// keeps the optimizer from dropping a result
+template <typename T> static void keep(T &&value)
+{
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+static std::vector<uint8_t> wifiSettingsPayload()
+{
+  std::vector<uint8_t> frame = ImprovHost::rpc(ImprovTypes::WIFI_SETTINGS, std::vector<std::string>{"Production-Line-07", "correct horse battery staple"});
+  return std::vector<uint8_t>(frame.begin() + 9, frame.end() - 1);
+}
+
+BENCH(rpc_decode_wifi_settings)
+{
+  std::vector<uint8_t> payload = wifiSettingsPayload();
+  state.bytes = payload.size();
+
+  for (uint64_t i = 0; i < state.iterations; i++)
+  {
+    ImprovTypes::ImprovCommandView cmd;
+    bool ok = ImprovRpcDecoder::decode(payload.data(), payload.size(), cmd);
+    keep(ok);
+    keep(cmd);
+  }
+}
+
+BENCH(rpc_decode_malformed)
+{
+  std::vector<uint8_t> payload = wifiSettingsPayload();
+  payload[2] = 200;
+  state.bytes = payload.size();
+
+  for (uint64_t i = 0; i < state.iterations; i++)
+  {
+    ImprovTypes::ImprovCommandView cmd;
+    bool ok = ImprovRpcDecoder::decode(payload.data(), payload.size(), cmd);
+    keep(ok);
+  }
+}
+
+BENCH(frame_assemble_and_decode)
+{
+  std::vector<uint8_t> frame = ImprovHost::rpc(ImprovTypes::WIFI_SETTINGS, std::vector<std::string>{"Production-Line-07", "correct horse battery staple"});
+  ImprovFrameAssembler assembler;
+  state.bytes = frame.size();
+
+  for (uint64_t i = 0; i < state.iterations; i++)
+  {
+    for (uint8_t b : frame)
+    {
+      if (assembler.push(b) == ImprovFrameAssembler::FRAME_COMPLETE)
+      {
+        ImprovTypes::ImprovCommandView cmd;
+        bool ok = ImprovRpcDecoder::decode(assembler.payload(), assembler.payloadLength(), cmd);
+        keep(ok);
+      }
+    }
+  }
+}
+
+// swallows the device output so only the library itself is measured; input only arrives with feed()
+class NullStream : public Stream
+{
+public:
+  void feed(const char *data)
+  {
+    input = data;
+    end = data + strlen(data);
+  }
+
+  int available() override { return end - input; }
+  int read() override { return input < end ? (uint8_t)*input++ : -1; }
+  int peek() override { return input < end ? (uint8_t)*input : -1; }
+  size_t write(uint8_t) override { return 1; }
+  size_t write(const uint8_t *buffer, size_t size) override { return size; }
+
+private:
+  const char *input = nullptr;
+  const char *end = nullptr;
+};
+
+struct ImprovWiFiBenchAccess
+{
+  static void invalidateResponseCache(ImprovWiFi &improv) { improv.invalidateResponseCache(); }
+
+  static void encodeAndSend(ImprovWiFi &improv, ImprovTypes::Command command, const std::vector<std::string> &strings)
+  {
+    std::vector<uint8_t> response = improv.build_rpc_response(command, strings, false);
+    improv.sendResponse(response);
+  }
+
+  static bool save(ImprovWiFi &improv, std::string &ssid, std::string &password) { return improv.saveWiFiCredentials(&ssid, &password); }
+  static bool load(ImprovWiFi &improv, String &ssid, String &password) { return improv.loadWiFiCredentials(ssid, password); }
+};
+
+// device with its own radio and flash, ImprovWiFi writing into a NullStream or a serial line
+template <typename StreamType> struct BenchDeviceOn
+{
+  FakeDevice device;
+  StreamType stream;
+  ImprovWiFi improv;
+
+  explicit BenchDeviceOn(unsigned accessPoints = 0) : stream(makeStream()), improv(&stream)
+  {
+    device.select();
+    improv.setClock(device.clock);
+    improv.setDeviceInfo(ImprovTypes::CF_ESP32, "ImprovWiFiLib", "1.0.0", "Benchmark");
+    for (unsigned i = 0; i < accessPoints; i++)
+    {
+      // every fourth network is seen on a second channel, as with mesh systems
+      std::string ssid = "Network-" + std::to_string(i - i % 4 / 3);
+      device.addAccessPoint(ssid.c_str(), "password", 1 + i % 13, -40 - (int)(i * 37 % 55), i % 7 ? FAKE_AUTH_WPA2_PSK : FAKE_AUTH_OPEN);
+    }
+  }
+
+private:
+  StreamType makeStream();
+};
+
+template <> NullStream BenchDeviceOn<NullStream>::makeStream() { return NullStream(); }
+template <> FakeSerial BenchDeviceOn<FakeSerial>::makeStream() { return FakeSerial(device.clock, serialBaud); }
+
+typedef BenchDeviceOn<NullStream> BenchDevice;
+
+// repeats a frame to fill a buffer of about 1 KB
+static std::vector<uint8_t> repeatFrame(const std::vector<uint8_t> &frame, size_t &frames)
+{
+  std::vector<uint8_t> buffer;
+  frames = 0;
+  while (buffer.size() + frame.size() <= 1024)
+  {
+    buffer.insert(buffer.end(), frame.begin(), frame.end());
+    frames++;
+  }
+  return buffer;
+}
+
+// handleBuffer() with 1 KB of the frame, per frame
+static void handleFrames(BenchState &state, BenchDevice &bench, const std::vector<uint8_t> &frame)
+{
+  size_t frames;
+  std::vector<uint8_t> buffer = repeatFrame(frame, frames);
+  state.bytes = frame.size();
+  state.opsPerIteration = frames;
+  state.resetTimer();
+
+  for (uint64_t i = 0; i < state.iterations; i++)
+    bench.improv.handleBuffer(buffer.data(), buffer.size());
+}
+
+// framing and checksum only, frames of type CURRENT_STATE are not dispatched
+BENCH(handle_buffer_frame_16)
+{
+  BenchDevice bench;
+  handleFrames(state, bench, ImprovHost::frame(ImprovTypes::TYPE_CURRENT_STATE, std::vector<uint8_t>(16, 0x55)));
+}
+
+BENCH(handle_buffer_frame_128)
+{
+  BenchDevice bench;
+  handleFrames(state, bench, ImprovHost::frame(ImprovTypes::TYPE_CURRENT_STATE, std::vector<uint8_t>(128, 0x55)));
+}
+
+BENCH(handle_buffer_frame_255)
+{
+  BenchDevice bench;
+  handleFrames(state, bench, ImprovHost::frame(ImprovTypes::TYPE_CURRENT_STATE, std::vector<uint8_t>(255, 0x55)));
+}
+
+// parse, decode and dispatch of an RPC with an unknown command, answered with an error frame
+BENCH(handle_buffer_unknown_rpc)
+{
+  BenchDevice bench;
+  handleFrames(state, bench, ImprovHost::rpc(0x7F));
+}
+
+// built-in command served from the cached response vs. a vendor command using the response encoder
+BENCH(handle_buffer_device_info)
+{
+  BenchDevice bench;
+  handleFrames(state, bench, ImprovHost::rpc(ImprovTypes::GET_DEVICE_INFO));
+}
+
+BENCH(handle_buffer_custom_rpc)
+{
+  BenchDevice bench;
+  bench.improv.registerRpcHandler(0xF1, [](const ImprovTypes::ImprovCommandView &cmd, ImprovResponseEncoder &response) {
+    return response.add("ok");
+  });
+  handleFrames(state, bench, ImprovHost::rpc(0xF1));
+}
+
+// GET_DEVICE_INFO with the cached frame dropped before every request, the strings stay the same
+BENCH(device_info_encode)
+{
+  BenchDevice bench;
+  std::vector<uint8_t> frame = ImprovHost::rpc(ImprovTypes::GET_DEVICE_INFO);
+  state.bytes = frame.size();
+  state.resetTimer();
+
+  for (uint64_t i = 0; i < state.iterations; i++)
+  {
+    ImprovWiFiBenchAccess::invalidateResponseCache(bench.improv);
+    bench.improv.handleBuffer(frame.data(), frame.size());
+  }
+}
+
+BENCH(build_rpc_response_and_send)
+{
+  BenchDevice bench;
+  const std::vector<std::string> strings = {"Production-Line-07", "-67", "YES"};
+  state.resetTimer();
+
+  for (uint64_t i = 0; i < state.iterations; i++)
+    ImprovWiFiBenchAccess::encodeAndSend(bench.improv, ImprovTypes::GET_WIFI_NETWORKS, strings);
+}
+
+// GET_WIFI_NETWORKS: sort by RSSI, drop duplicates, one response per network; the scan itself is free
+static void scanNetworks(BenchState &state, unsigned accessPoints, bool compact)
+{
+  std::vector<uint8_t> frame = compact ? ImprovHost::rpc(ImprovTypes::GET_WIFI_NETWORKS, std::vector<uint8_t>{ImprovTypes::NETWORK_LIST_COMPACT})
+                                       : ImprovHost::rpc(ImprovTypes::GET_WIFI_NETWORKS);
+
+  // the same request once on the serial line: what the client receives and how long it waits for it
+  BenchDeviceOn<FakeSerial> wire(accessPoints);
+  uint64_t start = wire.device.clock->millis64();
+  wire.stream.send(frame);
+  wire.improv.loop();
+  state.sessionMs = wire.device.clock->millis64() - start;
+  state.wireBytes = wire.stream.bytesToHost;
+
+  BenchDevice bench(accessPoints);
+  state.resetTimer();
+
+  for (uint64_t i = 0; i < state.iterations; i++)
+    bench.improv.handleBuffer(frame.data(), frame.size());
+}
+
+BENCH(scan_networks_4) { scanNetworks(state, 4, false); }
+BENCH(scan_networks_16) { scanNetworks(state, 16, false); }
+BENCH(scan_networks_64) { scanNetworks(state, 64, false); }
+BENCH(scan_networks_compact_64) { scanNetworks(state, 64, true); }
+
+// save and load of the credentials, on ESP8266 through LittleFS
+BENCH(credentials_save_load)
+{
+  BenchDevice bench;
+  std::string ssid = "Production-Line-07", password = "correct horse battery staple";
+  String loadedSsid, loadedPassword;
+  state.resetTimer();
+
+  for (uint64_t i = 0; i < state.iterations; i++)
+  {
+    bool ok = ImprovWiFiBenchAccess::save(bench.improv, ssid, password) &&
+              ImprovWiFiBenchAccess::load(bench.improv, loadedSsid, loadedPassword);
+    keep(ok);
+  }
+}
+
+BENCH(credentials_load)
+{
+  BenchDevice bench;
+  std::string ssid = "Production-Line-07", password = "correct horse battery staple";
+  ImprovWiFiBenchAccess::save(bench.improv, ssid, password);
+  String loadedSsid, loadedPassword;
+  state.resetTimer();
+
+  for (uint64_t i = 0; i < state.iterations; i++)
+  {
+    bool ok = ImprovWiFiBenchAccess::load(bench.improv, loadedSsid, loadedPassword);
+    keep(ok);
+  }
+}
+
+// loop() without credentials, listener active and dormant, and connected with the link monitor;
+// the idle cases get a line of log output from another program on the serial port per loop()
+static const char *UNRELATED_TRAFFIC = "[sensor] temp=21.4C hum=40% pressure=1013hPa uptime=123456s\r\n";
+
+static void loopIdle(BenchState &state, bool dormant)
+{
+  BenchDevice bench;
+  if (dormant)
+    bench.device.clock->sleep(IMPROV_RUN_FOR);
+  state.bytes = strlen(UNRELATED_TRAFFIC);
+  state.resetTimer();
+
+  for (uint64_t i = 0; i < state.iterations; i++)
+  {
+    bench.stream.feed(UNRELATED_TRAFFIC);
+    bench.improv.loop();
+  }
+}
+
+BENCH(loop_idle_active) { loopIdle(state, false); }
+BENCH(loop_idle_dormant) { loopIdle(state, true); }
+
+BENCH(loop_connected)
+{
+  BenchDevice bench(1);
+  bench.improv.enableRoaming(-75, 8);
+  std::vector<uint8_t> frame = ImprovHost::rpc(ImprovTypes::WIFI_SETTINGS, std::vector<std::string>{"Network-0", "password"});
+  bench.improv.handleBuffer(frame.data(), frame.size());
+  bench.improv.loop();
+
+  state.resetTimer();
+
+  for (uint64_t i = 0; i < state.iterations; i++)
+    bench.improv.loop();
+}
+
+struct BenchResult
+{
+  const char *name;
+  uint64_t iterations;
+  double nsPerOp;
+  double mbPerSecond;
+  uint64_t wireBytes;
+  uint64_t sessionMs;
+};
+
+static BenchResult measure(const BenchCase &bench)
+{
+  using clock = std::chrono::steady_clock;
+  BenchState state = {1};
+
+  for (;;)
+  {
+    state.resetTimer();
+    bench.run(state);
+    double ns = std::chrono::duration<double, std::nano>(clock::now() - state.start).count();
+
+    if (ns >= 200e6 || state.iterations >= (1ull << 40))
+    {
+      uint64_t ops = state.iterations * state.opsPerIteration;
+      double nsPerOp = ns / ops;
+      double mbPerSecond = state.bytes ? state.bytes * 1e3 / nsPerOp : 0;
+      return {bench.name, ops, nsPerOp, mbPerSecond, state.wireBytes, state.sessionMs};
+    }
+    // aim a bit above the minimum time
+    double factor = ns > 0 ? 250e6 / ns : 100;
+    state.iterations = (uint64_t)(state.iterations * (factor > 100 ? 100 : factor < 2 ? 2 : factor));
+  }
+}
+
+int main(int argc, char **argv)
+{
+  const char *filter = nullptr;
+  bool json = false;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--json") == 0)
+      json = true;
+    else if (strcmp(argv[i], "--baud") == 0 && i + 1 < argc)
+      serialBaud = atoi(argv[++i]);
+    else
+      filter = argv[i];
+  }
+
+  std::vector<BenchResult> results;
+  for (const BenchCase &bench : cases())
+  {
+    if (filter && !strstr(bench.name, filter))
+      continue;
+    results.push_back(measure(bench));
+    if (!json)
+    {
+      const BenchResult &r = results.back();
+      printf("%-36s %12.1f ns/op %12llu iterations", r.name, r.nsPerOp, (unsigned long long)r.iterations);
+      if (r.mbPerSecond > 0)
+        printf(" %10.1f MB/s", r.mbPerSecond);
+      if (r.wireBytes > 0)
+        printf(" %8llu B on the wire, %llu ms at %u baud", (unsigned long long)r.wireBytes, (unsigned long long)r.sessionMs, serialBaud);
+      printf("\n");
+    }
+  }
+
+  if (json)
+  {
+    printf("{\n  \"platform\": \"%s\",\n  \"baud\": %u,\n  \"benchmarks\": [\n", PLATFORM, serialBaud);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+      const BenchResult &r = results[i];
+      printf("    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.2f, \"mb_per_s\": %.2f", r.name,
+             (unsigned long long)r.iterations, r.nsPerOp, r.mbPerSecond);
+      if (r.wireBytes > 0)
+        printf(", \"wire_bytes\": %llu, \"session_ms\": %llu", (unsigned long long)r.wireBytes, (unsigned long long)r.sessionMs);
+      printf("}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+  }
+  return 0;
+}
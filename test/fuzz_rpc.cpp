@@ -0,0 +1,136 @@
+// Fuzz target for the frame assembler and the RPC decoder.
+//
+// Built with IMPROV_LIBFUZZER (clang, -fsanitize=fuzzer) the libFuzzer entry point is used.
+// Otherwise main() runs the given corpus files, or a number of random and mutated frames.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "ImprovFrameAssembler.h"
+#include "ImprovRpcDecoder.h"
+
+static void require(bool condition, const char *what)
+{
+  if (!condition)
+  {
+    fprintf(stderr, "invariant violated: %s\n", what);
+    abort();
+  }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  ImprovFrameAssembler assembler;
+
+  for (size_t i = 0; i < size; i++)
+  {
+    if (assembler.push(data[i]) != ImprovFrameAssembler::FRAME_COMPLETE)
+      continue;
+
+    const uint8_t *payload = assembler.payload();
+    size_t length = assembler.payloadLength();
+    require(length <= IMPROV_MAX_PAYLOAD, "payload within the assembler buffer");
+
+    ImprovTypes::ImprovCommandView cmd;
+    if (!ImprovRpcDecoder::decode(payload, length, cmd))
+      continue;
+
+    // every view has to stay inside the payload
+    require(cmd.data == payload + 2 && cmd.dataLength + 2u == length, "data view");
+    if (cmd.command == ImprovTypes::WIFI_SETTINGS)
+    {
+      const uint8_t *ssid = (const uint8_t *)cmd.ssid;
+      const uint8_t *password = (const uint8_t *)cmd.password;
+      require(ssid == payload + 3, "ssid view");
+      require(ssid + cmd.ssidLength < payload + length, "ssid inside the payload");
+      require(password == ssid + cmd.ssidLength + 1, "password view");
+      require(password + cmd.passwordLength <= payload + length, "password inside the payload");
+    }
+  }
+  return 0;
+}
+
+#ifndef IMPROV_LIBFUZZER
+
+// valid RPC frame with random content, mutated afterwards
+static std::vector<uint8_t> randomFrame(std::mt19937 &rng)
+{
+  uint8_t command = rng() % 4 == 0 ? rng() : ImprovTypes::WIFI_SETTINGS;
+  std::vector<uint8_t> payload = {command, 0};
+  size_t length = rng() % 254;
+  for (size_t i = 0; i < length; i++)
+    payload.push_back(rng() % 3 == 0 ? rng() % 40 : rng());
+  payload[1] = payload.size() - 2;
+
+  std::vector<uint8_t> frame = {'I', 'M', 'P', 'R', 'O', 'V', 1, 3, (uint8_t)payload.size()};
+  frame.insert(frame.end(), payload.begin(), payload.end());
+  uint8_t checksum = 0;
+  for (uint8_t b : frame)
+    checksum += b;
+  frame.push_back(checksum);
+
+  // flip, drop or repeat some bytes, most mutations are caught by the checksum
+  for (unsigned n = rng() % 3; n > 0 && !frame.empty(); n--)
+  {
+    size_t at = rng() % frame.size();
+    switch (rng() % 3)
+    {
+    case 0:
+      frame[at] ^= 1 << (rng() % 8);
+      break;
+    case 1:
+      frame.erase(frame.begin() + at);
+      break;
+    default:
+      frame.insert(frame.begin() + at, frame[at]);
+      break;
+    }
+  }
+  return frame;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc > 1 && atol(argv[1]) == 0)
+  {
+    // corpus files
+    for (int i = 1; i < argc; i++)
+    {
+      FILE *file = fopen(argv[i], "rb");
+      if (!file)
+        return 1;
+      std::vector<uint8_t> data;
+      int c;
+      while ((c = fgetc(file)) != EOF)
+        data.push_back(c);
+      fclose(file);
+      LLVMFuzzerTestOneInput(data.data(), data.size());
+    }
+    return 0;
+  }
+
+  long iterations = argc > 1 ? atol(argv[1]) : 100000;
+  std::mt19937 rng(argc > 2 ? atol(argv[2]) : 1);
+  std::vector<uint8_t> input;
+
+  for (long i = 0; i < iterations; i++)
+  {
+    input.clear();
+    // a few frames back to back, separated by noise
+    for (unsigned n = 1 + rng() % 3; n > 0; n--)
+    {
+      for (unsigned k = rng() % 8; k > 0; k--)
+        input.push_back(rng() % 2 ? rng() : 'I');
+      std::vector<uint8_t> frame = randomFrame(rng);
+      input.insert(input.end(), frame.begin(), frame.end());
+    }
+    LLVMFuzzerTestOneInput(input.data(), input.size());
+  }
+  printf("%ld inputs\n", iterations);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,162 @@
+// Replays an Improv session captured with ImprovCaptureStream against the host build of the library and
+// diffs the answers of the device with the recorded ones.
+//
+//   replay [--ap SSID,PASSWORD,CHANNEL,RSSI]... [--info FIRMWARE,VERSION,DEVICE] CAPTURE
+//   replay --record CAPTURE
+//
+// The device has to be set up like the one of the capture for the answers to match: --ap adds an access
+// point to its radio environment, --info sets its device info (chip family ESP32). Without them the
+// setup of --record is used, which records a scripted session (state, device info, scan, WiFi settings)
+// on the host. The exit code is 1 if the answers differ, 2 if the capture cannot be read.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "ImprovReplay.h"
+
+struct AccessPoint
+{
+  std::string ssid;
+  std::string password;
+  int channel;
+  int rssi;
+};
+
+struct Options
+{
+  std::vector<AccessPoint> accessPoints;
+  std::string firmware = "HostTest", version = "1.0.0", device = "Fixture";
+  const char *capture = nullptr;
+  bool record = false;
+};
+
+static std::vector<std::string> split(const char *text)
+{
+  std::vector<std::string> fields(1);
+  for (const char *c = text; *c; c++)
+  {
+    if (*c == ',')
+      fields.emplace_back();
+    else
+      fields.back() += *c;
+  }
+  return fields;
+}
+
+static void setUp(FakeDevice &device, const Options &options)
+{
+  if (options.accessPoints.empty())
+  {
+    device.addAccessPoint("Office", "pw", 1, -70);
+    device.addAccessPoint("MyNet", "secret123", 6, -50);
+    device.addAccessPoint("Guest", "", 11, -80, FAKE_AUTH_OPEN);
+    return;
+  }
+  for (const AccessPoint &ap : options.accessPoints)
+    device.addAccessPoint(ap.ssid.c_str(), ap.password.c_str(), ap.channel, ap.rssi, ap.password.empty() ? FAKE_AUTH_OPEN : FAKE_AUTH_WPA2_PSK);
+}
+
+static std::vector<uint8_t> recordSession(const Options &options)
+{
+  FakeDevice device;
+  setUp(device, options);
+
+  // the operator takes a moment for each step
+  return ImprovReplay::record(device, {
+    ImprovHost::rpc(ImprovTypes::GET_CURRENT_STATE),
+    ImprovHost::rpc(ImprovTypes::GET_DEVICE_INFO),
+    ImprovHost::rpc(ImprovTypes::GET_WIFI_NETWORKS),
+    ImprovHost::rpc(ImprovTypes::WIFI_SETTINGS, std::vector<std::string>{"MyNet", "wrong"}),
+    ImprovHost::rpc(ImprovTypes::WIFI_SETTINGS, std::vector<std::string>{"MyNet", "secret123"}),
+    ImprovHost::rpc(ImprovTypes::GET_CURRENT_STATE),
+  }, 750);
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    if (strcmp(arg, "--record") == 0)
+    {
+      options.record = true;
+      continue;
+    }
+    if (strncmp(arg, "--", 2) != 0)
+    {
+      if (options.capture)
+        return false;
+      options.capture = arg;
+      continue;
+    }
+    if (i + 1 >= argc)
+      return false;
+    std::vector<std::string> fields = split(argv[++i]);
+    if (strcmp(arg, "--ap") == 0 && fields.size() == 4)
+      options.accessPoints.push_back({fields[0], fields[1], atoi(fields[2].c_str()), atoi(fields[3].c_str())});
+    else if (strcmp(arg, "--info") == 0 && fields.size() == 3)
+    {
+      options.firmware = fields[0];
+      options.version = fields[1];
+      options.device = fields[2];
+    }
+    else
+      return false;
+  }
+  return options.capture != nullptr;
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+  if (!parseOptions(argc, argv, options))
+  {
+    fprintf(stderr, "usage: %s [--ap SSID,PASSWORD,CHANNEL,RSSI]... [--info FIRMWARE,VERSION,DEVICE] CAPTURE\n", argv[0]);
+    fprintf(stderr, "       %s --record CAPTURE\n", argv[0]);
+    return 2;
+  }
+
+  if (options.record)
+  {
+    std::vector<uint8_t> capture = recordSession(options);
+    FILE *file = fopen(options.capture, "wb");
+    if (!file || fwrite(capture.data(), 1, capture.size(), file) != capture.size())
+    {
+      fprintf(stderr, "cannot write %s\n", options.capture);
+      return 2;
+    }
+    fclose(file);
+    printf("recorded %zu bytes to %s\n", capture.size(), options.capture);
+    return 0;
+  }
+
+  std::vector<uint8_t> capture;
+  FILE *file = fopen(options.capture, "rb");
+  if (!file)
+  {
+    fprintf(stderr, "cannot read %s\n", options.capture);
+    return 2;
+  }
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    capture.insert(capture.end(), buffer, buffer + n);
+  fclose(file);
+
+  ImprovFixture f;
+  setUp(f.device, options);
+  f.improv.setDeviceInfo(ImprovTypes::CF_ESP32, options.firmware.c_str(), options.version.c_str(), options.device.c_str());
+
+  ImprovReplay::Result result = ImprovReplay::replay(f, capture);
+  for (const std::string &diff : result.diffs)
+    printf("  %s\n", diff.c_str());
+  printf("%zu client records, %zu frames recorded, %zu answered, %zu differences%s\n", result.records, result.expected.size(),
+         result.actual.size(), result.diffs.size(), result.malformed ? ", capture malformed" : "");
+
+  if (result.malformed)
+    return 2;
+  return result.diffs.empty() ? 0 : 1;
+}
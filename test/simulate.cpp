@@ -0,0 +1,288 @@
+// Fleet provisioning simulator: runs N ImprovWiFi instances against simulated radios and serial lines
+// and scripts a full Improv session on each (state, device info, scan, WiFi settings), followed by a
+// reboot which has to reconnect with the stored credentials.
+//
+//   simulate [--devices N] [--seed S] [--baud B] [--flaky P] [--typo P] [--lease-cache] [--json]
+//
+// --flaky is the probability of an association which never completes, --typo the probability that
+// the operator enters a wrong password first, --lease-cache enables the lease cache on the devices.
+// Time is virtual, so the sessions take no real time; the library timings are changed for the whole
+// host build, e.g.
+//   cmake -S . -B build -DIMPROV_HOST_DEFINES="IMPROV_CONNECT_TIMEOUT_MS=3000;DELAY_MS_WAIT_WIFI_CONNECTION=250"
+//
+// Reported are p50/p99 of the time to STATE_PROVISIONED and of the reconnect after the reboot, and the
+// frames per second: on the simulated serial lines and processed by the host.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ImprovFixture.h"
+
+using ImprovHost::Frame;
+
+static const char *LINE_SSID = "Line-AP";
+static const char *LINE_PASSWORD = "production-line-7";
+
+struct Options
+{
+  unsigned devices = 100;
+  unsigned seed = 1;
+  uint32_t baud = 115200;
+  double flaky = 0.1;
+  double typo = 0.05;
+  bool leaseCache = false;
+  bool json = false;
+};
+
+enum Step { GET_STATE, GET_DEVICE_INFO, GET_NETWORKS, SEND_SETTINGS, REBOOT, DONE };
+
+struct SimulatedDevice
+{
+  ImprovFixture fixture;
+  Step step = GET_STATE;
+  bool typo = false;
+  bool leaseCache = false;
+  bool failed = false;
+  unsigned settingsAttempts = 0;
+  uint64_t start = 0;
+  uint64_t provisionedMs = 0;
+  uint64_t reconnectMs = 0;
+  uint64_t frames = 0;
+
+  explicit SimulatedDevice(uint32_t baud) : fixture(baud) {}
+
+  uint64_t now() { return fixture.device.clock->millis64(); }
+
+  std::vector<Frame> request(const std::vector<uint8_t> &frame)
+  {
+    std::vector<Frame> frames = fixture.request(frame);
+    this->frames += 1 + frames.size();
+    return frames;
+  }
+};
+
+static bool contains(const std::vector<Frame> &frames, bool (*match)(const Frame &))
+{
+  return std::any_of(frames.begin(), frames.end(), match);
+}
+
+static std::unique_ptr<SimulatedDevice> createDevice(const Options &options, std::mt19937 &random)
+{
+  auto sim = std::make_unique<SimulatedDevice>(options.baud);
+  FakeDevice &device = sim->fixture.device;
+  std::uniform_int_distribution<int> percent(0, 99);
+  auto chance = [&](double p) { return percent(random) < p * 100; };
+
+  // radio conditions differ from station to station
+  device.scanMsPerChannel = std::uniform_int_distribution<uint32_t>(100, 140)(random);
+  device.associateMs = std::uniform_int_distribution<uint32_t>(150, 1500)(random);
+  device.dhcpMs = std::uniform_int_distribution<uint32_t>(80, 900)(random);
+  device.failAssociations = chance(options.flaky) ? 1 : 0;
+
+  static const uint8_t lineChannels[] = {1, 6, 11};
+  device.addAccessPoint(LINE_SSID, LINE_PASSWORD, lineChannels[random() % 3], std::uniform_int_distribution<int>(-80, -40)(random));
+  unsigned neighbours = random() % 16;
+  for (unsigned i = 0; i < neighbours; i++)
+  {
+    std::string ssid = "Neighbour-" + std::to_string(random() % 1000);
+    device.addAccessPoint(ssid.c_str(), "neighbour-pw", 1 + random() % 13, std::uniform_int_distribution<int>(-95, -50)(random));
+  }
+
+  sim->typo = chance(options.typo);
+  sim->leaseCache = options.leaseCache;
+  if (options.leaseCache)
+    sim->fixture.improv.enableLeaseCache();
+  return sim;
+}
+
+// runs the next request of the session, false when the session is over
+static bool advance(SimulatedDevice &sim, std::mt19937 &random)
+{
+  sim.fixture.device.select();
+  std::vector<Frame> frames;
+
+  switch (sim.step)
+  {
+  case GET_STATE:
+    sim.start = sim.now();
+    frames = sim.request(ImprovHost::rpc(ImprovTypes::GET_CURRENT_STATE));
+    sim.step = contains(frames, [](const Frame &f) { return isState(f, ImprovTypes::STATE_AUTHORIZED); }) ? GET_DEVICE_INFO : DONE;
+    sim.failed = sim.step == DONE;
+    return true;
+
+  case GET_DEVICE_INFO:
+    frames = sim.request(ImprovHost::rpc(ImprovTypes::GET_DEVICE_INFO));
+    sim.step = GET_NETWORKS;
+    return true;
+
+  case GET_NETWORKS:
+    frames = sim.request(ImprovHost::rpc(ImprovTypes::GET_WIFI_NETWORKS));
+    sim.step = SEND_SETTINGS;
+    return true;
+
+  case SEND_SETTINGS:
+  {
+    std::string password = sim.typo && sim.settingsAttempts == 0 ? "production-line-8" : LINE_PASSWORD;
+    sim.settingsAttempts++;
+    frames = sim.request(ImprovHost::rpc(ImprovTypes::WIFI_SETTINGS, std::vector<std::string>{LINE_SSID, password}));
+    if (contains(frames, [](const Frame &f) { return isState(f, ImprovTypes::STATE_PROVISIONED); }))
+    {
+      sim.provisionedMs = sim.now() - sim.start;
+      sim.step = REBOOT;
+    }
+    else if (sim.settingsAttempts >= 3)
+    {
+      sim.failed = true;
+      sim.step = DONE;
+    }
+    return true;
+  }
+
+  case REBOOT:
+  {
+    // power cycle: the stored credentials have to be found again, maybe with a flaky association
+    FakeDevice &device = sim.fixture.device;
+    device.disconnect();
+    device.failAssociations = random() % 10 == 0 ? 1 : 0;
+    FakeSerial serial(device.clock);
+    ImprovWiFi rebooted(&serial);
+    rebooted.setClock(device.clock);
+    if (sim.leaseCache)
+      rebooted.enableLeaseCache();
+    uint64_t start = sim.now();
+    try
+    {
+      sim.failed = !rebooted.ConnectToWifi();
+    }
+    catch (const FakeRestart &)
+    {
+      sim.failed = true;
+    }
+    sim.reconnectMs = sim.now() - start;
+    sim.step = DONE;
+    return true;
+  }
+
+  case DONE:
+    break;
+  }
+  return false;
+}
+
+static uint64_t percentile(std::vector<uint64_t> values, double p)
+{
+  if (values.empty())
+    return 0;
+  std::sort(values.begin(), values.end());
+  size_t rank = (size_t)(p / 100 * values.size() + 0.999999);
+  return values[std::min(values.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (strcmp(arg, "--json") == 0)
+    {
+      options.json = true;
+      continue;
+    }
+    if (strcmp(arg, "--lease-cache") == 0)
+    {
+      options.leaseCache = true;
+      continue;
+    }
+    if (!value)
+      return false;
+    if (strcmp(arg, "--devices") == 0)
+      options.devices = atoi(value);
+    else if (strcmp(arg, "--seed") == 0)
+      options.seed = atoi(value);
+    else if (strcmp(arg, "--baud") == 0)
+      options.baud = atoi(value);
+    else if (strcmp(arg, "--flaky") == 0)
+      options.flaky = atof(value);
+    else if (strcmp(arg, "--typo") == 0)
+      options.typo = atof(value);
+    else
+      return false;
+    i++;
+  }
+  return options.devices > 0;
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+  if (!parseOptions(argc, argv, options))
+  {
+    fprintf(stderr, "usage: %s [--devices N] [--seed S] [--baud B] [--flaky P] [--typo P] [--lease-cache] [--json]\n", argv[0]);
+    return 2;
+  }
+
+  std::mt19937 random(options.seed);
+  std::vector<std::unique_ptr<SimulatedDevice>> fleet;
+  for (unsigned i = 0; i < options.devices; i++)
+    fleet.push_back(createDevice(options, random));
+
+  // all instances live at once, the sessions are interleaved one request at a time
+  auto wallStart = std::chrono::steady_clock::now();
+  bool active = true;
+  while (active)
+  {
+    active = false;
+    for (auto &sim : fleet)
+      active |= advance(*sim, random);
+  }
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+  std::vector<uint64_t> provisioned, reconnected;
+  uint64_t frames = 0, lineMs = 0;
+  unsigned failed = 0;
+  for (auto &sim : fleet)
+  {
+    frames += sim->frames;
+    if (sim->failed)
+    {
+      failed++;
+      continue;
+    }
+    provisioned.push_back(sim->provisionedMs);
+    reconnected.push_back(sim->reconnectMs);
+    lineMs += sim->provisionedMs;
+  }
+
+  double hostFramesPerSecond = wallSeconds > 0 ? frames / wallSeconds : 0;
+  double lineFramesPerSecond = lineMs ? frames * 1000.0 / lineMs : 0;
+
+  if (options.json)
+  {
+    printf("{\n  \"devices\": %u,\n  \"failed\": %u,\n", options.devices, failed);
+    printf("  \"provisioned_ms\": {\"p50\": %llu, \"p99\": %llu, \"max\": %llu},\n", (unsigned long long)percentile(provisioned, 50),
+           (unsigned long long)percentile(provisioned, 99), (unsigned long long)percentile(provisioned, 100));
+    printf("  \"reconnect_ms\": {\"p50\": %llu, \"p99\": %llu, \"max\": %llu},\n", (unsigned long long)percentile(reconnected, 50),
+           (unsigned long long)percentile(reconnected, 99), (unsigned long long)percentile(reconnected, 100));
+    printf("  \"frames\": %llu,\n  \"frames_per_s_line\": %.2f,\n  \"frames_per_s_host\": %.0f\n}\n", (unsigned long long)frames,
+           lineFramesPerSecond, hostFramesPerSecond);
+  }
+  else
+  {
+    printf("devices              %u (%u failed)\n", options.devices, failed);
+    printf("time to provisioned  p50 %llu ms, p99 %llu ms, max %llu ms\n", (unsigned long long)percentile(provisioned, 50),
+           (unsigned long long)percentile(provisioned, 99), (unsigned long long)percentile(provisioned, 100));
+    printf("reconnect on reboot  p50 %llu ms, p99 %llu ms, max %llu ms\n", (unsigned long long)percentile(reconnected, 50),
+           (unsigned long long)percentile(reconnected, 99), (unsigned long long)percentile(reconnected, 100));
+    printf("frames               %llu, %.2f frames/s on the serial lines, %.0f frames/s on the host\n", (unsigned long long)frames,
+           lineFramesPerSecond, hostFramesPerSecond);
+  }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+// Host stand-in for the parts of the Arduino core used by the library.
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#define F(x) (x)
+
+typedef bool boolean;
+
+class String
+{
+public:
+  String() {}
+  String(const char *str) : value(str ? str : "") {}
+  String(const std::string &str) : value(str) {}
+
+  const char *c_str() const { return value.c_str(); }
+  unsigned int length() const { return value.size(); }
+  bool isEmpty() const { return value.empty(); }
+
+  String &operator=(const char *str)
+  {
+    value = str ? str : "";
+    return *this;
+  }
+
+  bool operator==(const String &other) const { return value == other.value; }
+  bool operator!=(const String &other) const { return value != other.value; }
+  bool operator==(const char *other) const { return value == other; }
+
+private:
+  std::string value;
+};
+
+class Print
+{
+public:
+  virtual ~Print() {}
+
+  virtual size_t write(uint8_t byte) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size)
+  {
+    size_t n = 0;
+    while (size--)
+      n += write(*buffer++);
+    return n;
+  }
+  size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+  virtual void flush() {}
+
+  size_t print(const char *str) { return write(str); }
+  size_t print(const String &str) { return write(str.c_str()); }
+  size_t println(const char *str = "") { return print(str) + print("\n"); }
+  size_t println(const String &str) { return println(str.c_str()); }
+
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+  {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    return n > 0 ? write((const uint8_t *)buffer, strnlen(buffer, sizeof(buffer))) : 0;
+  }
+};
+
+class Stream : public Print
+{
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  size_t readBytes(uint8_t *buffer, size_t length)
+  {
+    size_t n = 0;
+    int c;
+    while (n < length && (c = read()) >= 0)
+      buffer[n++] = (uint8_t)c;
+    return n;
+  }
+  size_t readBytes(char *buffer, size_t length) { return readBytes((uint8_t *)buffer, length); }
+};
+
+// Log output of the library, discarded unless IMPROV_HOST_LOG is set in the environment.
+class HardwareSerial : public Stream
+{
+public:
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  size_t write(uint8_t byte) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+
+  void begin(unsigned long) {}
+  void updateBaudRate(unsigned long) {}
+};
+
+extern HardwareSerial Serial;
+
+class IPAddress
+{
+public:
+  IPAddress() {}
+  IPAddress(uint32_t address) { memcpy(bytes, &address, 4); }
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes{a, b, c, d} {}
+
+  operator uint32_t() const
+  {
+    uint32_t address;
+    memcpy(&address, bytes, 4);
+    return address;
+  }
+  uint8_t operator[](int index) const { return bytes[index]; }
+
+  String toString() const
+  {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+    return String(buffer);
+  }
+
+private:
+  uint8_t bytes[4] = {0, 0, 0, 0};
+};
+
+// ESP.restart() ends the simulated run of the device
+struct FakeRestart
+{
+};
+
+class EspClass
+{
+public:
+  [[noreturn]] void restart() { throw FakeRestart(); }
+  uint32_t random();
+};
+
+extern EspClass ESP;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+uint32_t esp_random();
+
+#if defined(ARDUINO_ARCH_ESP8266)
+uint64_t micros64();
+#endif
@@ -0,0 +1,40 @@
+#pragma once
+
+// Host stand-in for the ESP8266 EEPROM emulation, backed by FakeDevice::current().
+// Like the real one it works on a RAM copy of the sector; commit() erases the whole
+// sector and writes it back, end() commits pending changes.
+
+#include <vector>
+#include "Arduino.h"
+
+class EEPROMClass
+{
+public:
+  void begin(size_t size);
+  uint8_t read(int address);
+  void write(int address, uint8_t value);
+  bool commit();
+  bool end();
+
+  template <typename T> T &get(int address, T &value)
+  {
+    memcpy((uint8_t *)&value, &data[address], sizeof(T));
+    return value;
+  }
+
+  template <typename T> const T &put(int address, const T &value)
+  {
+    if (memcmp(&data[address], (const uint8_t *)&value, sizeof(T)) != 0)
+    {
+      memcpy(&data[address], (const uint8_t *)&value, sizeof(T));
+      dirty = true;
+    }
+    return value;
+  }
+
+private:
+  std::vector<uint8_t> data;
+  bool dirty = false;
+};
+
+extern EEPROMClass EEPROM;
@@ -0,0 +1,68 @@
+#pragma once
+
+// Host stand-in for the ESP8266 Arduino core WiFi class, backed by FakeDevice::current().
+
+#include "Arduino.h"
+
+typedef uint8_t uint8;
+
+enum wl_enc_type {
+  ENC_TYPE_WEP = 5,
+  ENC_TYPE_TKIP = 2,
+  ENC_TYPE_CCMP = 4,
+  ENC_TYPE_NONE = 7,
+  ENC_TYPE_AUTO = 8
+};
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_SCAN_COMPLETED = 2,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_WRONG_PASSWORD = 6,
+  WL_DISCONNECTED = 7
+} wl_status_t;
+
+typedef enum { WIFI_OFF, WIFI_STA, WIFI_AP, WIFI_AP_STA } WiFiMode_t;
+
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED (-2)
+
+class ESP8266WiFiClass
+{
+public:
+  wl_status_t begin(const char *ssid, const char *passphrase = nullptr, int32_t channel = 0, const uint8_t *bssid = nullptr, bool connect = true);
+  bool config(IPAddress local_ip, IPAddress gateway, IPAddress subnet, IPAddress dns1 = (uint32_t)0, IPAddress dns2 = (uint32_t)0);
+  bool disconnect(bool wifioff = false);
+  wl_status_t status();
+
+  WiFiMode_t getMode();
+  bool mode(WiFiMode_t mode);
+
+  int8_t scanNetworks(bool async = false, bool show_hidden = false, uint8 channel = 0, uint8 *ssid = nullptr);
+  int8_t scanComplete();
+  void scanDelete();
+  String SSID(uint8_t i);
+  int32_t RSSI(uint8_t i);
+  uint8_t encryptionType(uint8_t i);
+  int32_t channel(uint8_t i);
+  uint8_t *BSSID(uint8_t i);
+
+  String SSID() const;
+  int32_t RSSI();
+  uint8_t channel();
+  uint8_t *BSSID();
+  IPAddress localIP();
+  IPAddress gatewayIP();
+  IPAddress subnetMask();
+  IPAddress dnsIP(uint8_t i = 0);
+  String macAddress();
+  uint8_t *macAddress(uint8_t *mac);
+
+private:
+  WiFiMode_t wifiMode = WIFI_OFF;
+};
+
+extern ESP8266WiFiClass WiFi;
@@ -0,0 +1,86 @@
+#include "Arduino.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+#if defined(ARDUINO_ARCH_ESP32)
+  #include "esp_timer.h"
+#endif
+
+HardwareSerial Serial;
+EspClass ESP;
+
+static bool logEnabled()
+{
+  static bool enabled = getenv("IMPROV_HOST_LOG") != nullptr;
+  return enabled;
+}
+
+size_t HardwareSerial::write(uint8_t byte)
+{
+  if (logEnabled())
+    fputc(byte, stderr);
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+  if (logEnabled())
+    fwrite(buffer, 1, size, stderr);
+  return size;
+}
+
+static uint64_t monotonicMicros()
+{
+  static const auto start = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+unsigned long millis()
+{
+  return monotonicMicros() / 1000;
+}
+
+unsigned long micros()
+{
+  return monotonicMicros();
+}
+
+void delay(unsigned long ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield()
+{
+}
+
+static std::mt19937 &randomGenerator()
+{
+  static std::mt19937 generator(0x1337);
+  return generator;
+}
+
+uint32_t EspClass::random()
+{
+  return randomGenerator()();
+}
+
+uint32_t esp_random()
+{
+  return randomGenerator()();
+}
+
+#if defined(ARDUINO_ARCH_ESP8266)
+uint64_t micros64()
+{
+  return monotonicMicros();
+}
+#else
+int64_t esp_timer_get_time()
+{
+  return monotonicMicros();
+}
+#endif
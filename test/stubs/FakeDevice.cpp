@@ -0,0 +1,210 @@
+#include "FakeDevice.h"
+
+#include <cstring>
+
+FakeDevice *FakeDevice::selected = nullptr;
+
+FakeDevice::FakeDevice() : clock(&ownClock), eeprom(4096, 0xFF)
+{
+}
+
+FakeDevice &FakeDevice::current()
+{
+  static FakeDevice fallback;
+  return selected ? *selected : fallback;
+}
+
+FakeAccessPoint &FakeDevice::addAccessPoint(const char *ssid, const char *password, uint8_t channel, int rssi, FakeAuth auth)
+{
+  FakeAccessPoint ap = {};
+  ap.ssid = ssid;
+  ap.password = password;
+  ap.channel = channel;
+  ap.rssi = rssi;
+  ap.auth = password[0] ? auth : FAKE_AUTH_OPEN;
+  uint8_t bssid[6] = {0x02, 0x00, 0x00, 0x00, (uint8_t)(accessPoints.size() >> 8), (uint8_t)accessPoints.size()};
+  memcpy(ap.bssid, bssid, 6);
+  accessPoints.push_back(ap);
+  return accessPoints.back();
+}
+
+FakeStatus FakeDevice::status()
+{
+  if (currentStatus == FAKE_CONNECTING && now() >= statusAt)
+  {
+    currentStatus = pendingStatus;
+    if (currentStatus == FAKE_WRONG_PASSWORD)
+    {
+      // the ESP32 reports an authentication failure as disconnect event, reason WIFI_REASON_AUTH_FAIL
+      for (auto &listener : disconnectListeners)
+        listener(202);
+    }
+    if (currentStatus != FAKE_CONNECTED)
+      connectedAp = -1;
+  }
+  return currentStatus;
+}
+
+void FakeDevice::begin(const char *ssid, const char *password, int32_t channel, const uint8_t *bssid)
+{
+  begins++;
+  beginChannel = channel;
+  beginWithBssid = bssid != nullptr;
+
+  // without a channel the firmware scans all of them first
+  uint64_t at = now() + (channel ? scanMsPerChannel : 14 * scanMsPerChannel);
+
+  connectedAp = -1;
+  for (size_t i = 0; i < accessPoints.size(); i++)
+  {
+    const FakeAccessPoint &ap = accessPoints[i];
+    if (ap.ssid != ssid || (channel && ap.channel != channel) || (bssid && memcmp(ap.bssid, bssid, 6) != 0))
+      continue;
+    if (connectedAp < 0 || ap.rssi > accessPoints[connectedAp].rssi)
+      connectedAp = i;
+  }
+
+  currentStatus = FAKE_CONNECTING;
+  if (connectedAp < 0)
+  {
+    pendingStatus = FAKE_NO_SSID;
+    statusAt = at;
+    return;
+  }
+
+  at += associateMs;
+  const FakeAccessPoint &ap = accessPoints[connectedAp];
+  if (failAssociations > 0)
+  {
+    // never completes, the caller runs into its timeout
+    failAssociations--;
+    pendingStatus = FAKE_CONNECTING;
+    statusAt = UINT64_MAX;
+  }
+  else if (ap.password != (password ? password : ""))
+  {
+    pendingStatus = FAKE_WRONG_PASSWORD;
+    statusAt = at;
+  }
+  else
+  {
+    // connected means an address is assigned, with DHCP that takes another exchange
+    if (!staticConfig)
+    {
+      at += dhcpMs;
+      ip = dhcpIp;
+      gateway = dhcpGateway;
+      subnet = dhcpSubnet;
+      dns1 = dhcpDns;
+      dns2 = 0;
+    }
+    dhcpDoneAt = at;
+    pendingStatus = FAKE_CONNECTED;
+    statusAt = at;
+  }
+}
+
+void FakeDevice::disconnect()
+{
+  connectedAp = -1;
+  currentStatus = FAKE_DISCONNECTED;
+}
+
+void FakeDevice::config(uint32_t ip, uint32_t gateway, uint32_t subnet, uint32_t dns1, uint32_t dns2)
+{
+  if (ip == 0)
+  {
+    // like arduino-esp32: the address is dropped until the DHCP client got a new one
+    if (staticConfig && status() == FAKE_CONNECTED)
+    {
+      dhcpRestarts++;
+      dhcpDoneAt = now() + dhcpMs;
+    }
+    staticConfig = false;
+    this->ip = dhcpIp;
+    this->gateway = dhcpGateway;
+    this->subnet = dhcpSubnet;
+    this->dns1 = dhcpDns;
+    this->dns2 = 0;
+    return;
+  }
+
+  staticConfig = true;
+  dhcpDoneAt = 0;
+  this->ip = ip;
+  this->gateway = gateway;
+  this->subnet = subnet;
+  this->dns1 = dns1;
+  this->dns2 = dns2;
+}
+
+uint32_t FakeDevice::localIP()
+{
+  if (status() != FAKE_CONNECTED || now() < dhcpDoneAt)
+    return 0;
+  return ip;
+}
+
+int FakeDevice::scan(bool async, bool showHidden, uint32_t msPerChannel, uint8_t channel, const char *ssid)
+{
+  scans++;
+  scannedChannels += channel ? 1 : 14;
+  scanResults.clear();
+  for (size_t i = 0; i < accessPoints.size(); i++)
+  {
+    const FakeAccessPoint &ap = accessPoints[i];
+    if (channel && ap.channel != channel)
+      continue;
+    if (ssid && ap.ssid != ssid)
+      continue;
+    // hidden networks only answer a probe for their SSID
+    if (ap.hidden && !(ssid && showHidden))
+      continue;
+    scanResults.push_back(i);
+  }
+
+  uint32_t duration = (msPerChannel ? msPerChannel : scanMsPerChannel) * (channel ? 1 : 14);
+  if (async)
+  {
+    scanRunning = true;
+    scanDoneAt = now() + duration;
+    return -1;
+  }
+
+  clock->sleep(duration);
+  if (failScans > 0)
+  {
+    failScans--;
+    scanResults.clear();
+    return -2;
+  }
+  return scanResults.size();
+}
+
+int FakeDevice::scanComplete()
+{
+  if (scanRunning && now() < scanDoneAt)
+    return -1;
+  scanRunning = false;
+  return scanResults.size();
+}
+
+void FakeDevice::scanDelete()
+{
+  scanRunning = false;
+  scanResults.clear();
+}
+
+bool FakeDevice::storageOperation(uint32_t latencyMs)
+{
+  clock->sleep(latencyMs);
+  if (powerFailAfter < 0)
+    return false;
+  if (powerFailAfter == 0)
+  {
+    powerFailAfter = -1;
+    return true;
+  }
+  powerFailAfter--;
+  return false;
+}
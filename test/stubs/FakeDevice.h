@@ -0,0 +1,136 @@
+#pragma once
+
+// State behind the host stand-ins of WiFi, NVS, EEPROM and the flash file system.
+// Every simulated device owns one FakeDevice; the stand-ins act on the selected one,
+// so several ImprovWiFi instances can run in one process.
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ImprovClock.h"
+
+// authentication of an access point, values of the ESP32 wifi_auth_mode_t
+enum FakeAuth : uint8_t {
+  FAKE_AUTH_OPEN = 0,
+  FAKE_AUTH_WEP = 1,
+  FAKE_AUTH_WPA_PSK = 2,
+  FAKE_AUTH_WPA2_PSK = 3,
+  FAKE_AUTH_WPA_WPA2_PSK = 4,
+  FAKE_AUTH_WPA2_ENTERPRISE = 5,
+  FAKE_AUTH_WPA3_PSK = 6,
+  FAKE_AUTH_WPA2_WPA3_PSK = 7,
+};
+
+struct FakeAccessPoint {
+  std::string ssid;
+  std::string password;
+  uint8_t bssid[6];
+  uint8_t channel;
+  int rssi;
+  FakeAuth auth;
+  bool hidden;
+};
+
+// thrown by the storage operation hit by FakeDevice::powerFailAfter
+struct FakePowerFail
+{
+};
+
+enum FakeStatus : uint8_t {
+  FAKE_IDLE,
+  FAKE_CONNECTING,
+  FAKE_CONNECTED,
+  FAKE_NO_SSID,
+  FAKE_WRONG_PASSWORD,
+  FAKE_DISCONNECTED,
+};
+
+class FakeDevice
+{
+public:
+  FakeDevice();
+  FakeDevice(const FakeDevice &) = delete;
+  FakeDevice &operator=(const FakeDevice &) = delete;
+
+  // device the stand-ins act on, a default device if none was selected
+  static FakeDevice &current();
+  void select() { selected = this; }
+
+  // time of the device, scans, association and flash latencies advance it
+  ImprovClock *clock;
+  uint64_t now() { return clock->millis64(); }
+
+  // radio environment
+  std::vector<FakeAccessPoint> accessPoints;
+  uint8_t  mac[6] = {0x24, 0x0A, 0xC4, 0x00, 0x00, 0x01};
+  uint32_t scanMsPerChannel = 120;  // dwell time of a scan without explicit one
+  uint32_t associateMs = 300;       // authentication and association
+  uint32_t dhcpMs = 200;            // DHCP exchange after association
+  int      failAssociations = 0;    // the next n associations time out
+  uint32_t dhcpIp = 0x6401A8C0;     // 192.168.1.100
+  uint32_t dhcpGateway = 0x0101A8C0;
+  uint32_t dhcpSubnet = 0x00FFFFFF;
+  uint32_t dhcpDns = 0x0101A8C0;
+  uint32_t dhcpLeaseSeconds = 86400;
+
+  FakeAccessPoint &addAccessPoint(const char *ssid, const char *password, uint8_t channel, int rssi,
+                                  FakeAuth auth = FAKE_AUTH_WPA2_PSK);
+
+  // connection state
+  FakeStatus status();
+  int  connectedAp = -1;           // index into accessPoints while connected or connecting
+  uint64_t statusAt = 0;           // time the pending status is reached
+  FakeStatus pendingStatus = FAKE_IDLE;
+  FakeStatus currentStatus = FAKE_IDLE;
+  bool     staticConfig = false;
+  uint32_t ip = 0, gateway = 0, subnet = 0, dns1 = 0, dns2 = 0;
+  uint64_t dhcpDoneAt = 0;         // address assigned by DHCP from then on
+  uint32_t begins = 0;             // calls of WiFi.begin()
+  uint32_t beginChannel = 0;       // channel passed to the last WiFi.begin()
+  bool     beginWithBssid = false;
+  uint32_t dhcpRestarts = 0;       // WiFi.config() with a zero address while connected
+  uint32_t conflictIp = 0;         // address held by another host of the network
+  std::vector<uint32_t> arpRequests;
+  std::vector<std::function<void(uint8_t reason)>> disconnectListeners;
+
+  void begin(const char *ssid, const char *password, int32_t channel, const uint8_t *bssid);
+  void disconnect();
+  void config(uint32_t ip, uint32_t gateway, uint32_t subnet, uint32_t dns1, uint32_t dns2);
+  uint32_t localIP();
+  // true if a host of the network answers an ARP request for `ip`: the gateway or the conflicting host
+  bool arpAnswers(uint32_t ip) { return status() == FAKE_CONNECTED && (ip == dhcpGateway || ip == conflictIp); }
+  const FakeAccessPoint *ap() { return connectedAp >= 0 ? &accessPoints[connectedAp] : nullptr; }
+
+  // scans, synchronous ones advance the clock by their duration
+  std::vector<int> scanResults;
+  uint64_t scanDoneAt = 0;
+  bool     scanRunning = false;
+  uint32_t scans = 0;
+  uint32_t scannedChannels = 0;    // channels scanned so far, all channels count as 14
+  int      failScans = 0;          // the next n synchronous scans return WIFI_SCAN_FAILED
+  int scan(bool async, bool showHidden, uint32_t msPerChannel, uint8_t channel, const char *ssid);
+  int scanComplete();
+  void scanDelete();
+
+  // storage
+  std::map<std::string, std::vector<uint8_t>> nvs;      // "namespace/key"
+  std::vector<uint8_t> eeprom;                         // the EEPROM sector
+  std::map<std::string, std::vector<uint8_t>> files;   // flash file system
+  bool     fsFormatted = true;      // false: LittleFS only mounts with auto format
+  bool     fsMounted = false;
+  uint32_t flashEraseMs = 0;       // latency of a sector erase
+  uint32_t flashWriteMs = 0;       // latency of a write
+  int      powerFailAfter = -1;    // storage operations until the power fails, -1 never
+  uint32_t sectorErases = 0;
+
+  // account for one storage operation, true if the power is cut during it: the caller
+  // then leaves the operation torn and throws FakePowerFail
+  bool storageOperation(uint32_t latencyMs);
+
+private:
+  static FakeDevice *selected;
+  ImprovVirtualClock ownClock;
+};
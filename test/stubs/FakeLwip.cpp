@@ -0,0 +1,46 @@
+#include "FakeDevice.h"
+#include "lwip/dhcp.h"
+#include "lwip/etharp.h"
+
+#include <algorithm>
+
+struct netif *fakeNetifDefault()
+{
+  static struct netif netif;
+  FakeDevice &device = FakeDevice::current();
+  uint32_t ip = device.localIP();
+  if (ip == 0)
+    return nullptr;
+  netif.ip_addr.addr = ip;
+  netif.gw.addr = device.gateway;
+  return &netif;
+}
+
+struct dhcp *fakeDhcpData(struct netif *netif)
+{
+  static struct dhcp dhcp;
+  FakeDevice &device = FakeDevice::current();
+  if (device.staticConfig || device.localIP() == 0)
+    return nullptr;
+  dhcp.offered_t0_lease = device.dhcpLeaseSeconds;
+  return &dhcp;
+}
+
+err_t etharp_request(struct netif *netif, const ip4_addr_t *ipaddr)
+{
+  FakeDevice::current().arpRequests.push_back(ipaddr->addr);
+  return ERR_OK;
+}
+
+ssize_t etharp_find_addr(struct netif *netif, const ip4_addr_t *ipaddr, struct eth_addr **eth_ret, const ip4_addr_t **ip_ret)
+{
+  static struct eth_addr mac = {{0x02, 0x00, 0x00, 0x00, 0x00, 0x01}};
+  FakeDevice &device = FakeDevice::current();
+  const std::vector<uint32_t> &requests = device.arpRequests;
+  bool requested = std::find(requests.begin(), requests.end(), ipaddr->addr) != requests.end();
+  if (!requested || !device.arpAnswers(ipaddr->addr))
+    return -1;
+  *eth_ret = &mac;
+  *ip_ret = ipaddr;
+  return 0;
+}
@@ -0,0 +1,227 @@
+#include "FakeSha256.h"
+
+#include <cstring>
+
+#include "bearssl/bearssl_hmac.h"
+#include "mbedtls/md.h"
+
+static const uint32_t K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static uint32_t rotr(uint32_t x, int n)
+{
+  return (x >> n) | (x << (32 - n));
+}
+
+void FakeSha256::reset()
+{
+  static const uint32_t initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                      0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  memcpy(state, initial, sizeof(state));
+  total = 0;
+  used = 0;
+}
+
+void FakeSha256::compress(const uint8_t *chunk)
+{
+  uint32_t w[64];
+  for (int i = 0; i < 16; i++)
+    w[i] = (uint32_t)chunk[4 * i] << 24 | (uint32_t)chunk[4 * i + 1] << 16 | (uint32_t)chunk[4 * i + 2] << 8 | chunk[4 * i + 3];
+  for (int i = 16; i < 64; i++)
+  {
+    uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+  uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+  for (int i = 0; i < 64; i++)
+  {
+    uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+    uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
+}
+
+void FakeSha256::update(const uint8_t *data, size_t length)
+{
+  total += length;
+  while (length > 0)
+  {
+    size_t n = sizeof(block) - used < length ? sizeof(block) - used : length;
+    memcpy(&block[used], data, n);
+    used += n;
+    data += n;
+    length -= n;
+    if (used == sizeof(block))
+    {
+      compress(block);
+      used = 0;
+    }
+  }
+}
+
+void FakeSha256::finish(uint8_t digest[32])
+{
+  uint64_t bits = total * 8;
+  uint8_t padding[72] = {0x80};
+  size_t padLength = (used < 56 ? 56 : 120) - used;
+  uint8_t length[8];
+  for (int i = 0; i < 8; i++)
+    length[i] = bits >> (56 - 8 * i);
+  update(padding, padLength);
+  update(length, 8);
+
+  for (int i = 0; i < 8; i++)
+  {
+    digest[4 * i] = state[i] >> 24;
+    digest[4 * i + 1] = state[i] >> 16;
+    digest[4 * i + 2] = state[i] >> 8;
+    digest[4 * i + 3] = state[i];
+  }
+}
+
+void FakeHmacSha256::start(const uint8_t *key, size_t length)
+{
+  memset(pad, 0, sizeof(pad));
+  if (length > sizeof(pad))
+  {
+    FakeSha256 hash;
+    hash.update(key, length);
+    hash.finish(pad);
+  }
+  else
+  {
+    memcpy(pad, key, length);
+  }
+
+  uint8_t ipad[64];
+  for (size_t i = 0; i < sizeof(ipad); i++)
+    ipad[i] = pad[i] ^ 0x36;
+  inner.reset();
+  inner.update(ipad, sizeof(ipad));
+}
+
+void FakeHmacSha256::finish(uint8_t mac[32])
+{
+  uint8_t innerDigest[32];
+  inner.finish(innerDigest);
+
+  uint8_t opad[64];
+  for (size_t i = 0; i < sizeof(opad); i++)
+    opad[i] = pad[i] ^ 0x5c;
+  FakeSha256 outer;
+  outer.update(opad, sizeof(opad));
+  outer.update(innerDigest, sizeof(innerDigest));
+  outer.finish(mac);
+}
+
+// mbedtls
+
+struct mbedtls_md_info_t
+{
+  int type;
+};
+
+static const mbedtls_md_info_t sha256Info = {MBEDTLS_MD_SHA256};
+
+const mbedtls_md_info_t *mbedtls_md_info_from_type(mbedtls_md_type_t type)
+{
+  return type == MBEDTLS_MD_SHA256 ? &sha256Info : nullptr;
+}
+
+void mbedtls_md_init(mbedtls_md_context_t *ctx)
+{
+  ctx->state = nullptr;
+}
+
+int mbedtls_md_setup(mbedtls_md_context_t *ctx, const mbedtls_md_info_t *info, int hmac)
+{
+  if (!info || !hmac)
+    return -1;
+  ctx->state = new FakeHmacSha256();
+  return 0;
+}
+
+int mbedtls_md_hmac_starts(mbedtls_md_context_t *ctx, const unsigned char *key, size_t keylen)
+{
+  static_cast<FakeHmacSha256 *>(ctx->state)->start(key, keylen);
+  return 0;
+}
+
+int mbedtls_md_hmac_update(mbedtls_md_context_t *ctx, const unsigned char *input, size_t ilen)
+{
+  static_cast<FakeHmacSha256 *>(ctx->state)->update(input, ilen);
+  return 0;
+}
+
+int mbedtls_md_hmac_finish(mbedtls_md_context_t *ctx, unsigned char *output)
+{
+  static_cast<FakeHmacSha256 *>(ctx->state)->finish(output);
+  return 0;
+}
+
+void mbedtls_md_free(mbedtls_md_context_t *ctx)
+{
+  delete static_cast<FakeHmacSha256 *>(ctx->state);
+  ctx->state = nullptr;
+}
+
+// BearSSL
+
+const br_hash_class br_sha256_vtable = {4};
+
+void br_hmac_key_init(br_hmac_key_context *kc, const br_hash_class *, const void *key, size_t key_len)
+{
+  memset(kc->key, 0, sizeof(kc->key));
+  if (key_len > sizeof(kc->key))
+  {
+    FakeSha256 hash;
+    hash.update((const uint8_t *)key, key_len);
+    hash.finish(kc->key);
+  }
+  else
+  {
+    memcpy(kc->key, key, key_len);
+  }
+}
+
+void br_hmac_init(br_hmac_context *ctx, const br_hmac_key_context *kc, size_t)
+{
+  ctx->hmac.start(kc->key, sizeof(kc->key));
+}
+
+void br_hmac_update(br_hmac_context *ctx, const void *data, size_t len)
+{
+  ctx->hmac.update((const uint8_t *)data, len);
+}
+
+size_t br_hmac_out(const br_hmac_context *ctx, void *out)
+{
+  FakeHmacSha256 copy = ctx->hmac;
+  copy.finish((uint8_t *)out);
+  return 32;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+// SHA-256 and HMAC-SHA256 (FIPS 180-4, RFC 2104) behind the mbedtls and BearSSL stand-ins.
+
+#include <cstddef>
+#include <cstdint>
+
+class FakeSha256
+{
+public:
+  FakeSha256() { reset(); }
+
+  void reset();
+  void update(const uint8_t *data, size_t length);
+  void finish(uint8_t digest[32]);
+
+private:
+  uint32_t state[8];
+  uint64_t total;
+  uint8_t  block[64];
+  size_t   used;
+
+  void compress(const uint8_t *chunk);
+};
+
+class FakeHmacSha256
+{
+public:
+  void start(const uint8_t *key, size_t length);
+  void update(const uint8_t *data, size_t length) { inner.update(data, length); }
+  void finish(uint8_t mac[32]);
+
+private:
+  uint8_t    pad[64];
+  FakeSha256 inner;
+};
@@ -0,0 +1,248 @@
+#include <algorithm>
+
+#include "FakeDevice.h"
+
+#if defined(ARDUINO_ARCH_ESP8266)
+  #include "EEPROM.h"
+  #include "LittleFS.h"
+  EEPROMClass EEPROM;
+  FS LittleFS;
+#else
+  #include "Preferences.h"
+#endif
+
+static FakeDevice &device()
+{
+  return FakeDevice::current();
+}
+
+#if defined(ARDUINO_ARCH_ESP8266)
+
+void EEPROMClass::begin(size_t size)
+{
+  FakeDevice &d = device();
+  if (size > d.eeprom.size())
+    size = d.eeprom.size();
+  data.assign(d.eeprom.begin(), d.eeprom.begin() + size);
+  dirty = false;
+}
+
+uint8_t EEPROMClass::read(int address)
+{
+  return data[address];
+}
+
+void EEPROMClass::write(int address, uint8_t value)
+{
+  if (data[address] != value)
+  {
+    data[address] = value;
+    dirty = true;
+  }
+}
+
+bool EEPROMClass::commit()
+{
+  if (!dirty)
+    return true;
+
+  FakeDevice &d = device();
+  d.sectorErases++;
+  bool cut = d.storageOperation(d.flashEraseMs);
+  std::fill(d.eeprom.begin(), d.eeprom.end(), 0xFF);
+  if (cut)
+    throw FakePowerFail();
+
+  cut = d.storageOperation(d.flashWriteMs);
+  // a cut write leaves the first half of the data in the sector
+  size_t written = cut ? data.size() / 2 : data.size();
+  std::copy(data.begin(), data.begin() + written, d.eeprom.begin());
+  if (cut)
+    throw FakePowerFail();
+
+  dirty = false;
+  return true;
+}
+
+bool EEPROMClass::end()
+{
+  bool result = commit();
+  data.clear();
+  return result;
+}
+
+bool FS::begin()
+{
+  FakeDevice &d = device();
+  if (!d.fsFormatted)
+  {
+    if (!config.autoFormat)
+      return false;
+    d.files.clear();
+    d.fsFormatted = true;
+  }
+  d.fsMounted = true;
+  return true;
+}
+
+void FS::end()
+{
+  device().fsMounted = false;
+}
+
+File FS::open(const char *path, const char *mode)
+{
+  FakeDevice &d = device();
+  if (!d.fsMounted)
+    return File();
+
+  bool writable = mode[0] == 'w';
+  auto it = d.files.find(path);
+  if (!writable)
+    return it == d.files.end() ? File() : File(path, false, it->second);
+
+  // the truncation is committed when the file is opened
+  if (d.storageOperation(d.flashWriteMs))
+    throw FakePowerFail();
+  d.files[path].clear();
+  return File(path, true, {});
+}
+
+bool FS::exists(const char *path)
+{
+  FakeDevice &d = device();
+  return d.fsMounted && d.files.count(path) > 0;
+}
+
+bool FS::remove(const char *path)
+{
+  FakeDevice &d = device();
+  if (!d.fsMounted || d.files.count(path) == 0)
+    return false;
+  if (d.storageOperation(d.flashWriteMs))
+    throw FakePowerFail();
+  d.files.erase(path);
+  return true;
+}
+
+bool FS::rename(const char *pathFrom, const char *pathTo)
+{
+  FakeDevice &d = device();
+  auto it = d.files.find(pathFrom);
+  if (!d.fsMounted || it == d.files.end())
+    return false;
+  if (d.storageOperation(d.flashWriteMs))
+    throw FakePowerFail();
+  std::vector<uint8_t> content = it->second;
+  d.files.erase(it);
+  d.files[pathTo] = content;
+  return true;
+}
+
+size_t File::write(const uint8_t *data, size_t length)
+{
+  if (!valid || !writable)
+    return 0;
+  content.insert(content.end(), data, data + length);
+  return length;
+}
+
+size_t File::read(uint8_t *buffer, size_t length)
+{
+  if (!valid)
+    return 0;
+  length = std::min(length, content.size() - position);
+  memcpy(buffer, content.data() + position, length);
+  position += length;
+  return length;
+}
+
+void File::close()
+{
+  if (!valid)
+    return;
+  valid = false;
+  if (!writable)
+    return;
+
+  // copy-on-write: a cut before the commit leaves the file as it was after open()
+  FakeDevice &d = device();
+  if (d.storageOperation(d.flashWriteMs))
+    throw FakePowerFail();
+  d.files[path] = content;
+}
+
+#else
+
+bool Preferences::begin(const char *name, bool readOnly)
+{
+  space = name;
+  open = true;
+  this->readOnly = readOnly;
+  return true;
+}
+
+void Preferences::end()
+{
+  open = false;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t length)
+{
+  if (!open || readOnly)
+    return 0;
+  FakeDevice &d = device();
+  // NVS appends the new entry before it invalidates the old one, a cut leaves the old value
+  if (d.storageOperation(d.flashWriteMs))
+    throw FakePowerFail();
+  d.nvs[path(key)].assign((const uint8_t *)value, (const uint8_t *)value + length);
+  return length;
+}
+
+size_t Preferences::getBytes(const char *key, void *buffer, size_t length)
+{
+  FakeDevice &d = device();
+  auto it = d.nvs.find(path(key));
+  if (!open || it == d.nvs.end() || it->second.size() > length)
+    return 0;
+  memcpy(buffer, it->second.data(), it->second.size());
+  return it->second.size();
+}
+
+size_t Preferences::getBytesLength(const char *key)
+{
+  FakeDevice &d = device();
+  auto it = d.nvs.find(path(key));
+  return open && it != d.nvs.end() ? it->second.size() : 0;
+}
+
+size_t Preferences::putString(const char *key, const char *value)
+{
+  return putBytes(key, value, strlen(value) + 1) ? strlen(value) : 0;
+}
+
+String Preferences::getString(const char *key, String defaultValue)
+{
+  FakeDevice &d = device();
+  auto it = d.nvs.find(path(key));
+  if (!open || it == d.nvs.end())
+    return defaultValue;
+  return String(std::string((const char *)it->second.data(), strnlen((const char *)it->second.data(), it->second.size())));
+}
+
+bool Preferences::isKey(const char *key)
+{
+  return open && device().nvs.count(path(key)) > 0;
+}
+
+bool Preferences::remove(const char *key)
+{
+  if (!open || readOnly)
+    return false;
+  FakeDevice &d = device();
+  if (d.storageOperation(d.flashWriteMs))
+    throw FakePowerFail();
+  return d.nvs.erase(path(key)) > 0;
+}
+
+#endif
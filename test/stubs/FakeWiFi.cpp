@@ -0,0 +1,258 @@
+#include "FakeDevice.h"
+
+#if defined(ARDUINO_ARCH_ESP8266)
+  #include "ESP8266WiFi.h"
+  typedef ESP8266WiFiClass FakeWiFiClass;
+  typedef WiFiMode_t FakeWiFiMode;
+#else
+  #include "WiFi.h"
+  typedef WiFiClass FakeWiFiClass;
+  typedef wifi_mode_t FakeWiFiMode;
+#endif
+
+FakeWiFiClass WiFi;
+
+static FakeDevice &device()
+{
+  return FakeDevice::current();
+}
+
+static const FakeAccessPoint *scanned(uint8_t i)
+{
+  FakeDevice &d = device();
+  return i < d.scanResults.size() ? &d.accessPoints[d.scanResults[i]] : nullptr;
+}
+
+wl_status_t FakeWiFiClass::begin(const char *ssid, const char *passphrase, int32_t channel, const uint8_t *bssid, bool)
+{
+  device().begin(ssid, passphrase, channel, bssid);
+  return status();
+}
+
+bool FakeWiFiClass::config(IPAddress local_ip, IPAddress gateway, IPAddress subnet, IPAddress dns1, IPAddress dns2)
+{
+  device().config(local_ip, gateway, subnet, dns1, dns2);
+  return true;
+}
+
+wl_status_t FakeWiFiClass::status()
+{
+  switch (device().status())
+  {
+  case FAKE_CONNECTED:
+    return WL_CONNECTED;
+  case FAKE_NO_SSID:
+    return WL_NO_SSID_AVAIL;
+#if defined(ARDUINO_ARCH_ESP8266)
+  case FAKE_WRONG_PASSWORD:
+    return WL_WRONG_PASSWORD;
+#endif
+  case FAKE_IDLE:
+    return WL_IDLE_STATUS;
+  default:
+    return WL_DISCONNECTED;
+  }
+}
+
+FakeWiFiMode FakeWiFiClass::getMode()
+{
+  return wifiMode;
+}
+
+bool FakeWiFiClass::mode(FakeWiFiMode mode)
+{
+  wifiMode = mode;
+  return true;
+}
+
+#if defined(ARDUINO_ARCH_ESP8266)
+
+bool FakeWiFiClass::disconnect(bool)
+{
+  device().disconnect();
+  return true;
+}
+
+int8_t FakeWiFiClass::scanNetworks(bool async, bool show_hidden, uint8 channel, uint8 *ssid)
+{
+  return device().scan(async, show_hidden, 0, channel, (const char *)ssid);
+}
+
+int8_t FakeWiFiClass::scanComplete()
+{
+  return device().scanComplete();
+}
+
+uint8_t FakeWiFiClass::encryptionType(uint8_t i)
+{
+  const FakeAccessPoint *ap = scanned(i);
+  if (!ap)
+    return 0xFF;
+  switch (ap->auth)
+  {
+  case FAKE_AUTH_OPEN:
+    return ENC_TYPE_NONE;
+  case FAKE_AUTH_WEP:
+    return ENC_TYPE_WEP;
+  case FAKE_AUTH_WPA_PSK:
+    return ENC_TYPE_TKIP;
+  case FAKE_AUTH_WPA2_PSK:
+    return ENC_TYPE_CCMP;
+  case FAKE_AUTH_WPA_WPA2_PSK:
+    return ENC_TYPE_AUTO;
+  default:
+    // like the core, which has no value for the other modes
+    return 0xFF;
+  }
+}
+
+String FakeWiFiClass::SSID() const
+{
+  const FakeAccessPoint *ap = device().ap();
+  return ap ? String(ap->ssid) : String();
+}
+
+int32_t FakeWiFiClass::RSSI()
+{
+  const FakeAccessPoint *ap = device().ap();
+  return ap ? ap->rssi : 0;
+}
+
+uint8_t FakeWiFiClass::channel()
+{
+  const FakeAccessPoint *ap = device().ap();
+  return ap ? ap->channel : 0;
+}
+
+#else
+
+bool FakeWiFiClass::disconnect(bool, bool)
+{
+  device().disconnect();
+  return true;
+}
+
+wifi_event_id_t FakeWiFiClass::onEvent(WiFiEventFuncCb cb, arduino_event_id_t event)
+{
+  FakeDevice &d = device();
+  d.disconnectListeners.push_back([cb, event](uint8_t reason) {
+    arduino_event_info_t info = {};
+    info.wifi_sta_disconnected.reason = reason;
+    cb(event, info);
+  });
+  return d.disconnectListeners.size();
+}
+
+void FakeWiFiClass::removeEvent(wifi_event_id_t id)
+{
+  FakeDevice &d = device();
+  if (id > 0 && id <= d.disconnectListeners.size())
+    d.disconnectListeners[id - 1] = [](uint8_t) {};
+}
+
+int16_t FakeWiFiClass::scanNetworks(bool async, bool show_hidden, bool, uint32_t max_ms_per_chan, uint8_t channel, const char *ssid, const uint8_t *)
+{
+  return device().scan(async, show_hidden, max_ms_per_chan, channel, ssid);
+}
+
+int16_t FakeWiFiClass::scanComplete()
+{
+  return device().scanComplete();
+}
+
+wifi_auth_mode_t FakeWiFiClass::encryptionType(uint8_t i)
+{
+  const FakeAccessPoint *ap = scanned(i);
+  return ap ? (wifi_auth_mode_t)ap->auth : WIFI_AUTH_MAX;
+}
+
+String FakeWiFiClass::SSID()
+{
+  const FakeAccessPoint *ap = device().ap();
+  return ap ? String(ap->ssid) : String();
+}
+
+int8_t FakeWiFiClass::RSSI()
+{
+  const FakeAccessPoint *ap = device().ap();
+  return ap ? ap->rssi : 0;
+}
+
+int32_t FakeWiFiClass::channel()
+{
+  const FakeAccessPoint *ap = device().ap();
+  return ap ? ap->channel : 0;
+}
+
+#endif
+
+void FakeWiFiClass::scanDelete()
+{
+  device().scanDelete();
+}
+
+String FakeWiFiClass::SSID(uint8_t i)
+{
+  const FakeAccessPoint *ap = scanned(i);
+  return ap && !ap->hidden ? String(ap->ssid) : String();
+}
+
+int32_t FakeWiFiClass::RSSI(uint8_t i)
+{
+  const FakeAccessPoint *ap = scanned(i);
+  return ap ? ap->rssi : 0;
+}
+
+int32_t FakeWiFiClass::channel(uint8_t i)
+{
+  const FakeAccessPoint *ap = scanned(i);
+  return ap ? ap->channel : 0;
+}
+
+uint8_t *FakeWiFiClass::BSSID(uint8_t i)
+{
+  const FakeAccessPoint *ap = scanned(i);
+  return ap ? (uint8_t *)ap->bssid : nullptr;
+}
+
+uint8_t *FakeWiFiClass::BSSID()
+{
+  static uint8_t none[6];
+  const FakeAccessPoint *ap = device().ap();
+  return ap ? (uint8_t *)ap->bssid : none;
+}
+
+IPAddress FakeWiFiClass::localIP()
+{
+  return IPAddress(device().localIP());
+}
+
+IPAddress FakeWiFiClass::gatewayIP()
+{
+  return IPAddress(device().localIP() ? device().gateway : 0);
+}
+
+IPAddress FakeWiFiClass::subnetMask()
+{
+  return IPAddress(device().localIP() ? device().subnet : 0);
+}
+
+IPAddress FakeWiFiClass::dnsIP(uint8_t i)
+{
+  FakeDevice &d = device();
+  return IPAddress(d.localIP() ? (i == 0 ? d.dns1 : d.dns2) : 0);
+}
+
+String FakeWiFiClass::macAddress()
+{
+  const uint8_t *m = device().mac;
+  char buffer[18];
+  snprintf(buffer, sizeof(buffer), "%02X:%02X:%02X:%02X:%02X:%02X", m[0], m[1], m[2], m[3], m[4], m[5]);
+  return String(buffer);
+}
+
+uint8_t *FakeWiFiClass::macAddress(uint8_t *mac)
+{
+  memcpy(mac, device().mac, 6);
+  return mac;
+}
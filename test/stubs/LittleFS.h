@@ -0,0 +1,66 @@
+#pragma once
+
+// Host stand-in for the LittleFS file system of the ESP8266 core, backed by FakeDevice::current().
+// Like LittleFS, the data of a file is committed by close() and rename() replaces the target
+// atomically; opening with "w" truncates the file right away.
+
+#include <vector>
+#include "Arduino.h"
+
+class FSConfig
+{
+public:
+  FSConfig &setAutoFormat(bool value = true)
+  {
+    autoFormat = value;
+    return *this;
+  }
+  bool autoFormat = true;
+};
+
+class LittleFSConfig : public FSConfig
+{
+};
+
+class File
+{
+public:
+  File() {}
+  File(const char *path, bool writable, const std::vector<uint8_t> &content)
+      : path(path), writable(writable), valid(true), content(content) {}
+
+  explicit operator bool() const { return valid; }
+
+  size_t write(const uint8_t *data, size_t length);
+  size_t read(uint8_t *buffer, size_t length);
+  size_t size() const { return content.size(); }
+  void close();
+
+private:
+  std::string path;
+  bool writable = false;
+  bool valid = false;
+  std::vector<uint8_t> content;
+  size_t position = 0;
+};
+
+class FS
+{
+public:
+  bool setConfig(const FSConfig &config)
+  {
+    this->config = config;
+    return true;
+  }
+  bool begin();
+  void end();
+  File open(const char *path, const char *mode);
+  bool exists(const char *path);
+  bool remove(const char *path);
+  bool rename(const char *pathFrom, const char *pathTo);
+
+private:
+  FSConfig config;
+};
+
+extern FS LittleFS;
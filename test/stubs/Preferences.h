@@ -0,0 +1,28 @@
+#pragma once
+
+// Host stand-in for the arduino-esp32 NVS wrapper, backed by FakeDevice::current().
+// Like NVS, every put replaces the value of a key atomically.
+
+#include "Arduino.h"
+
+class Preferences
+{
+public:
+  bool begin(const char *name, bool readOnly = false);
+  void end();
+
+  size_t putBytes(const char *key, const void *value, size_t length);
+  size_t getBytes(const char *key, void *buffer, size_t length);
+  size_t getBytesLength(const char *key);
+  size_t putString(const char *key, const char *value);
+  String getString(const char *key, String defaultValue = String());
+  bool isKey(const char *key);
+  bool remove(const char *key);
+
+private:
+  std::string space;
+  bool        open = false;
+  bool        readOnly = false;
+
+  std::string path(const char *key) { return space + "/" + key; }
+};
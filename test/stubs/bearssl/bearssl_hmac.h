@@ -0,0 +1,26 @@
+#pragma once
+
+// Host stand-in for the BearSSL HMAC API, SHA-256 only.
+
+#include <cstddef>
+#include <cstdint>
+#include "FakeSha256.h"
+
+typedef struct {
+  int id;
+} br_hash_class;
+
+extern const br_hash_class br_sha256_vtable;
+
+typedef struct {
+  uint8_t key[64];
+} br_hmac_key_context;
+
+typedef struct {
+  FakeHmacSha256 hmac;
+} br_hmac_context;
+
+void br_hmac_key_init(br_hmac_key_context *kc, const br_hash_class *digest_vtable, const void *key, size_t key_len);
+void br_hmac_init(br_hmac_context *ctx, const br_hmac_key_context *kc, size_t out_len);
+void br_hmac_update(br_hmac_context *ctx, const void *data, size_t len);
+size_t br_hmac_out(const br_hmac_context *ctx, void *out);
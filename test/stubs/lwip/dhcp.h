@@ -0,0 +1,13 @@
+#pragma once
+
+// Host stand-in for the lwIP DHCP client, bound while FakeDevice::current() got its address from DHCP.
+
+#include "lwip/netif.h"
+
+struct dhcp {
+  uint32_t offered_t0_lease;
+};
+
+struct dhcp *fakeDhcpData(struct netif *netif);
+#define netif_dhcp_data(netif) fakeDhcpData(netif)
+#define dhcp_supplied_address(netif) (fakeDhcpData(netif) != nullptr)
@@ -0,0 +1,17 @@
+#pragma once
+
+// Host stand-in for the lwIP ARP module. Requests are answered by the network of
+// FakeDevice::current() at once, see FakeDevice::arpAnswers().
+
+#include <sys/types.h>
+
+#include "lwip/netif.h"
+
+struct eth_addr {
+  uint8_t addr[6];
+};
+
+err_t etharp_request(struct netif *netif, const ip4_addr_t *ipaddr);
+ssize_t etharp_find_addr(struct netif *netif, const ip4_addr_t *ipaddr, struct eth_addr **eth_ret, const ip4_addr_t **ip_ret);
+
+#define etharp_gratuitous(netif) etharp_request((netif), netif_ip4_addr(netif))
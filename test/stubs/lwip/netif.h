@@ -0,0 +1,27 @@
+#pragma once
+
+// Host stand-in for the lwIP network interface, the station interface of FakeDevice::current().
+
+#include <cstdint>
+
+typedef int8_t err_t;
+#define ERR_OK 0
+
+typedef struct ip4_addr {
+  uint32_t addr;
+} ip4_addr_t;
+
+#define ip4_addr_get_u32(a) ((a)->addr)
+#define ip4_addr_set_u32(a, v) ((a)->addr = (v))
+
+struct netif {
+  ip4_addr_t ip_addr;
+  ip4_addr_t gw;
+};
+
+#define netif_ip4_addr(n) ((const ip4_addr_t *)&(n)->ip_addr)
+#define netif_ip4_gw(n) ((const ip4_addr_t *)&(n)->gw)
+
+// the interface while the device has an address, nullptr otherwise
+struct netif *fakeNetifDefault();
+#define netif_default fakeNetifDefault()
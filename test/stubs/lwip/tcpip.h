@@ -0,0 +1,13 @@
+#pragma once
+
+// Host stand-in for the lwIP thread API: the host has no lwIP thread, callbacks run at once.
+
+#include "lwip/netif.h"
+
+typedef void (*tcpip_callback_fn)(void *ctx);
+
+inline err_t tcpip_callback(tcpip_callback_fn function, void *ctx)
+{
+  function(ctx);
+  return ERR_OK;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+// Mock transport between a host tool and ImprovWiFi. With a baud rate set, every byte costs
+// its transmission time on the clock, and bytes sent at a rate the other side does not
+// listen at arrive garbled.
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "Arduino.h"
+#include "ImprovClock.h"
+
+class FakeSerial : public Stream
+{
+public:
+  explicit FakeSerial(ImprovClock *clock = nullptr, uint32_t baud = 0) : clock(clock), baud(baud), hostBaud(baud) {}
+
+  ImprovClock *clock;
+  uint32_t baud;       // rate of the device UART, 0 for no transmission time
+  uint32_t hostBaud;   // rate the host talks and listens at
+  uint64_t bytesFromHost = 0;
+  uint64_t bytesToHost = 0;
+
+  // host side
+  void send(const uint8_t *data, size_t length)
+  {
+    transmit(length);
+    for (size_t i = 0; i < length; i++)
+      input.push_back(hostBaud == baud ? data[i] : garble(data[i]));
+    bytesFromHost += length;
+  }
+  void send(const std::vector<uint8_t> &data) { send(data.data(), data.size()); }
+
+  // everything the device wrote since the last call
+  std::vector<uint8_t> take()
+  {
+    std::vector<uint8_t> result;
+    result.swap(output);
+    return result;
+  }
+
+  // device side
+  int available() override { return input.size(); }
+
+  int read() override
+  {
+    if (input.empty())
+      return -1;
+    uint8_t byte = input.front();
+    input.pop_front();
+    return byte;
+  }
+
+  int peek() override { return input.empty() ? -1 : input.front(); }
+
+  size_t write(uint8_t byte) override { return write(&byte, 1); }
+
+  size_t write(const uint8_t *data, size_t length) override
+  {
+    transmit(length);
+    for (size_t i = 0; i < length; i++)
+      output.push_back(hostBaud == baud ? data[i] : garble(data[i]));
+    bytesToHost += length;
+    return length;
+  }
+
+  using Print::write;
+
+private:
+  std::deque<uint8_t>  input;
+  std::vector<uint8_t> output;
+  uint64_t             pendingMicros = 0;
+
+  // 8N1: ten bit times per byte
+  void transmit(size_t length)
+  {
+    if (!clock || baud == 0)
+      return;
+    pendingMicros += length * 10000000ull / baud;
+    clock->sleep(pendingMicros / 1000);
+    pendingMicros %= 1000;
+  }
+
+  static uint8_t garble(uint8_t byte)
+  {
+    return byte * 7 + 0x5A;
+  }
+};
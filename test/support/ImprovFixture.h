@@ -0,0 +1,40 @@
+#pragma once
+
+// One simulated device: radio and storage, serial line and the ImprovWiFi instance under test.
+
+#include "FakeDevice.h"
+#include "FakeSerial.h"
+#include "ImprovHost.h"
+#include "ImprovWiFiLibrary.h"
+
+struct ImprovFixture
+{
+  FakeDevice device;
+  FakeSerial serial;
+  ImprovWiFi improv;
+
+  explicit ImprovFixture(uint32_t baud = 0) : serial(device.clock, baud), improv(&serial)
+  {
+    device.select();
+    improv.setClock(device.clock);
+    improv.setDeviceInfo(ImprovTypes::CF_ESP32, "HostTest", "1.0.0", "Fixture");
+  }
+
+  // send a frame, run one loop() and return the frames the device answered with
+  std::vector<ImprovHost::Frame> request(const std::vector<uint8_t> &frame)
+  {
+    serial.send(frame);
+    improv.loop();
+    return ImprovHost::parse(serial.take());
+  }
+};
+
+inline bool isState(const ImprovHost::Frame &frame, ImprovTypes::State state)
+{
+  return frame.type == ImprovTypes::TYPE_CURRENT_STATE && frame.payload.size() == 1 && frame.payload[0] == state;
+}
+
+inline bool isError(const ImprovHost::Frame &frame, ImprovTypes::Error error)
+{
+  return frame.type == ImprovTypes::TYPE_ERROR_STATE && frame.payload.size() == 1 && frame.payload[0] == error;
+}
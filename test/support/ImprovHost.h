@@ -0,0 +1,78 @@
+#pragma once
+
+// Host side of the Improv serial protocol: builds RPC frames and splits the device output into frames.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ImprovFrameAssembler.h"
+#include "ImprovTypes.h"
+
+namespace ImprovHost {
+
+struct Frame
+{
+  uint8_t type;
+  std::vector<uint8_t> payload;
+};
+
+inline std::vector<uint8_t> frame(uint8_t type, const std::vector<uint8_t> &payload)
+{
+  std::vector<uint8_t> data = {'I', 'M', 'P', 'R', 'O', 'V', ImprovTypes::IMPROV_SERIAL_VERSION, type, (uint8_t)payload.size()};
+  data.insert(data.end(), payload.begin(), payload.end());
+  uint8_t checksum = 0;
+  for (uint8_t b : data)
+    checksum += b;
+  data.push_back(checksum);
+  return data;
+}
+
+// RPC with raw data bytes
+inline std::vector<uint8_t> rpc(uint8_t command, const std::vector<uint8_t> &data = {})
+{
+  std::vector<uint8_t> payload = {command, (uint8_t)data.size()};
+  payload.insert(payload.end(), data.begin(), data.end());
+  return frame(ImprovTypes::TYPE_RPC, payload);
+}
+
+// RPC with length-prefixed strings
+inline std::vector<uint8_t> rpc(uint8_t command, const std::vector<std::string> &strings)
+{
+  std::vector<uint8_t> data;
+  for (const std::string &s : strings)
+  {
+    data.push_back(s.size());
+    data.insert(data.end(), s.begin(), s.end());
+  }
+  return rpc(command, data);
+}
+
+inline std::vector<Frame> parse(const std::vector<uint8_t> &data)
+{
+  std::vector<Frame> frames;
+  ImprovFrameAssembler assembler;
+  for (uint8_t b : data)
+  {
+    if (assembler.push(b) == ImprovFrameAssembler::FRAME_COMPLETE)
+      frames.push_back({assembler.type(), std::vector<uint8_t>(assembler.payload(), assembler.payload() + assembler.payloadLength())});
+  }
+  return frames;
+}
+
+// strings of an RPC response payload (command, length, strings)
+inline std::vector<std::string> strings(const Frame &frame)
+{
+  std::vector<std::string> result;
+  for (size_t i = 2; i < frame.payload.size();)
+  {
+    size_t length = frame.payload[i];
+    if (i + 1 + length > frame.payload.size())
+      break;
+    result.emplace_back((const char *)&frame.payload[i + 1], length);
+    i += 1 + length;
+  }
+  return result;
+}
+
+} // namespace ImprovHost
@@ -0,0 +1,189 @@
+#pragma once
+
+// Host replay of captures written by ImprovCaptureStream: the client side of the capture is sent to an
+// ImprovFixture at its recorded time, the frames the device answers with are diffed against the
+// recorded ones (type and payload, in order). Frames are matched per client record, so a lost or
+// extra frame does not shift the rest of the session.
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "ImprovCapture.h"
+#include "ImprovFixture.h"
+
+namespace ImprovReplay {
+
+// capture log kept in memory
+class CaptureLog : public Print
+{
+public:
+  std::vector<uint8_t> data;
+
+  size_t write(uint8_t byte) override
+  {
+    data.push_back(byte);
+    return 1;
+  }
+  size_t write(const uint8_t *buffer, size_t size) override
+  {
+    data.insert(data.end(), buffer, buffer + size);
+    return size;
+  }
+};
+
+struct TimedFrame
+{
+  uint64_t time;     // milliseconds since the start of the session
+  size_t   record;   // number of client records sent before the frame
+  ImprovHost::Frame frame;
+};
+
+// complete frames of a byte stream, stamped with the time their last byte was seen
+class FrameCollector
+{
+public:
+  std::vector<TimedFrame> frames;
+
+  void push(uint64_t time, size_t record, const uint8_t *data, size_t length)
+  {
+    for (size_t i = 0; i < length; i++)
+    {
+      if (assembler.push(data[i]) == ImprovFrameAssembler::FRAME_COMPLETE)
+        frames.push_back({time, record, {assembler.type(), std::vector<uint8_t>(assembler.payload(), assembler.payload() + assembler.payloadLength())}});
+    }
+  }
+
+private:
+  ImprovFrameAssembler assembler;
+};
+
+struct Result
+{
+  bool malformed = false;     // the capture could not be read to its end
+  size_t records = 0;         // client records sent to the device
+  std::vector<TimedFrame> expected;
+  std::vector<TimedFrame> actual;
+  std::vector<std::string> diffs;
+};
+
+inline std::string describe(const TimedFrame &frame)
+{
+  char text[16];
+  snprintf(text, sizeof(text), "%6llu ms  %02X", (unsigned long long)frame.time, frame.frame.type);
+  std::string result = text;
+  for (uint8_t b : frame.frame.payload)
+  {
+    snprintf(text, sizeof(text), " %02X", b);
+    result += text;
+  }
+  return result;
+}
+
+inline bool sameFrame(const TimedFrame &a, const TimedFrame &b)
+{
+  return a.frame.type == b.frame.type && a.frame.payload == b.frame.payload;
+}
+
+// diffs the frames answering one client record: longest common subsequence, a missing and an unexpected
+// frame of the same type next to each other are reported as one changed frame
+inline void diffRecord(Result &result, size_t record)
+{
+  std::vector<const TimedFrame *> expected, actual;
+  for (const TimedFrame &frame : result.expected)
+    if (frame.record == record)
+      expected.push_back(&frame);
+  for (const TimedFrame &frame : result.actual)
+    if (frame.record == record)
+      actual.push_back(&frame);
+
+  size_t n = expected.size(), m = actual.size();
+  std::vector<std::vector<size_t>> common(n + 1, std::vector<size_t>(m + 1, 0));
+  for (size_t i = n; i-- > 0;)
+    for (size_t j = m; j-- > 0;)
+      common[i][j] = sameFrame(*expected[i], *actual[j]) ? common[i + 1][j + 1] + 1 : std::max(common[i + 1][j], common[i][j + 1]);
+
+  size_t i = 0, j = 0;
+  while (i < n || j < m)
+  {
+    if (i < n && j < m && sameFrame(*expected[i], *actual[j]))
+    {
+      i++;
+      j++;
+    }
+    else if (i < n && j < m && expected[i]->frame.type == actual[j]->frame.type && common[i + 1][j + 1] == common[i][j])
+    {
+      result.diffs.push_back("expected    " + describe(*expected[i]) + "\n  got         " + describe(*actual[j]));
+      i++;
+      j++;
+    }
+    else if (j >= m || (i < n && common[i + 1][j] >= common[i][j + 1]))
+      result.diffs.push_back("missing     " + describe(*expected[i++]));
+    else
+      result.diffs.push_back("unexpected  " + describe(*actual[j++]));
+  }
+}
+
+// runs the requests against a new ImprovWiFi on `device` whose serial line is captured, one loop() per
+// request and `pauseMs` between them; returns the capture
+inline std::vector<uint8_t> record(FakeDevice &device, const std::vector<std::vector<uint8_t>> &requests, uint32_t pauseMs)
+{
+  device.select();
+  FakeSerial serial(device.clock);
+  CaptureLog log;
+  ImprovCaptureStream capture(&serial, &log, device.clock);
+  ImprovWiFi improv(&capture);
+  improv.setClock(device.clock);
+  improv.setDeviceInfo(ImprovTypes::CF_ESP32, "HostTest", "1.0.0", "Fixture");
+
+  for (const std::vector<uint8_t> &request : requests)
+  {
+    serial.send(request);
+    improv.loop();
+    serial.take();
+    device.clock->sleep(pauseMs);
+  }
+  capture.flush();
+  return log.data;
+}
+
+inline Result replay(ImprovFixture &f, const std::vector<uint8_t> &capture)
+{
+  Result result;
+  FrameCollector expected, actual;
+  ImprovCaptureReader reader(capture.data(), capture.size());
+  ImprovCaptureReader::Record record;
+  uint64_t start = f.device.clock->millis64();
+
+  f.device.select();
+  while (reader.next(record))
+  {
+    if (record.direction == ImprovCaptureStream::CAPTURE_OUT)
+    {
+      expected.push(record.time, result.records, record.data, record.length);
+      continue;
+    }
+
+    // at the recorded time, unless the device is still busy with the previous request
+    uint64_t now = f.device.clock->millis64() - start;
+    if (record.time > now)
+      f.device.clock->sleep(record.time - now);
+
+    f.serial.send(record.data, record.length);
+    f.improv.loop();
+    result.records++;
+    std::vector<uint8_t> output = f.serial.take();
+    actual.push(f.device.clock->millis64() - start, result.records, output.data(), output.size());
+  }
+
+  result.malformed = reader.malformed();
+  result.expected = expected.frames;
+  result.actual = actual.frames;
+
+  for (size_t request = 0; request <= result.records; request++)
+    diffRecord(result, request);
+  return result;
+}
+
+} // namespace ImprovReplay
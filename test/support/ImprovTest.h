@@ -0,0 +1,54 @@
+#pragma once
+
+// Minimal test runner: TEST() registers a case, CHECK() records a failure and continues.
+
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+struct ImprovTestCase
+{
+  const char *name;
+  void (*run)();
+
+  static std::vector<ImprovTestCase> &all()
+  {
+    static std::vector<ImprovTestCase> cases;
+    return cases;
+  }
+
+  ImprovTestCase(const char *name, void (*run)()) : name(name), run(run)
+  {
+    all().push_back(*this);
+  }
+};
+
+extern int improvTestFailures;
+
+#define TEST(name)                                            \
+  static void name();                                         \
+  static ImprovTestCase name##_case(#name, name);             \
+  static void name()
+
+#define CHECK(condition)                                                          \
+  do                                                                              \
+  {                                                                               \
+    if (!(condition))                                                             \
+    {                                                                             \
+      improvTestFailures++;                                                       \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+    }                                                                             \
+  } while (0)
+
+#define CHECK_EQ(actual, expected)                                                                  \
+  do                                                                                                \
+  {                                                                                                 \
+    auto a_ = (actual);                                                                             \
+    auto e_ = (expected);                                                                           \
+    if (!(a_ == e_))                                                                                \
+    {                                                                                               \
+      improvTestFailures++;                                                                         \
+      fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #actual, \
+              #expected, (long long)a_, (long long)e_);                                             \
+    }                                                                                               \
+  } while (0)
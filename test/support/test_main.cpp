@@ -0,0 +1,22 @@
+#include "ImprovTest.h"
+
+#include <cstring>
+
+int improvTestFailures = 0;
+
+// runs all cases, or the ones whose name contains argv[1]
+int main(int argc, char **argv)
+{
+  int run = 0;
+  for (const ImprovTestCase &test : ImprovTestCase::all())
+  {
+    if (argc > 1 && !strstr(test.name, argv[1]))
+      continue;
+    int before = improvTestFailures;
+    test.run();
+    run++;
+    printf("%s %s\n", improvTestFailures == before ? "PASS" : "FAIL", test.name);
+  }
+  printf("%d tests, %d failed checks\n", run, improvTestFailures);
+  return improvTestFailures == 0 && run > 0 ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+#include <cstdio>
+
+#include "ImprovFixture.h"
+#include "ImprovTest.h"
+
+using ImprovHost::Frame;
+
+// device whose UART follows the negotiated rate, the host keeps its rate unless told otherwise
+struct BaudFixture : ImprovFixture
+{
+  std::vector<uint32_t> switches;
+  uint64_t lastSwitchAt = 0;
+  uint32_t failingRate = 0;   // the driver reports this rate as not set, e.g. its divisor is too far off
+
+  BaudFixture() : ImprovFixture(115200)
+  {
+    improv.setBaudRateSwitching(115200, 921600, [this](uint32_t baud) {
+      serial.baud = baud;
+      switches.push_back(baud);
+      lastSwitchAt = device.clock->millis64();
+      if (baud != failingRate)
+        return true;
+      // the host got the acknowledgement and already listens at the new rate
+      serial.hostBaud = baud;
+      return false;
+    });
+  }
+
+  std::vector<Frame> setBaudRate(const char *baud)
+  {
+    return request(ImprovHost::rpc(ImprovTypes::SET_BAUD_RATE, std::vector<std::string>{baud}));
+  }
+};
+
+TEST(handshake_acknowledges_at_the_old_rate)
+{
+  BaudFixture f;
+
+  std::vector<Frame> frames = f.setBaudRate("921600");
+
+  CHECK(frames.size() == 1 && frames[0].type == ImprovTypes::TYPE_RPC_RESPONSE);
+  CHECK(frames.size() == 1 && ImprovHost::strings(frames[0]) == std::vector<std::string>{"921600"});
+  CHECK_EQ(f.serial.baud, 921600u);
+
+  // the client follows, its first frame confirms the rate
+  f.serial.hostBaud = 921600;
+  frames = f.request(ImprovHost::rpc(ImprovTypes::GET_CURRENT_STATE));
+  CHECK(frames.size() == 1 && isState(frames[0], ImprovTypes::STATE_AUTHORIZED));
+
+  f.device.clock->sleep(IMPROV_BAUD_CONFIRM_MS * 2);
+  f.improv.loop();
+  CHECK_EQ(f.serial.baud, 921600u);
+  CHECK_EQ(f.switches.size(), (size_t)1);
+}
+
+TEST(unconfirmed_rate_falls_back)
+{
+  BaudFixture f;
+  f.setBaudRate("921600");
+
+  // the client missed the acknowledgement, its frame arrives garbled
+  CHECK(f.request(ImprovHost::rpc(ImprovTypes::GET_CURRENT_STATE)).empty());
+
+  f.device.clock->sleep(IMPROV_BAUD_CONFIRM_MS);
+  f.improv.loop();
+  CHECK_EQ(f.serial.baud, 115200u);
+
+  std::vector<Frame> frames = f.request(ImprovHost::rpc(ImprovTypes::GET_CURRENT_STATE));
+  CHECK(frames.size() == 1 && isState(frames[0], ImprovTypes::STATE_AUTHORIZED));
+}
+
+TEST(fallback_while_connect_blocks)
+{
+  BaudFixture f;
+  f.device.addAccessPoint("MyNet", "secret123", 6, -50);
+  f.request(ImprovHost::rpc(ImprovTypes::WIFI_SETTINGS, std::vector<std::string>{"MyNet", "secret123"}));
+  CHECK(f.improv.isConnected());
+
+  f.setBaudRate("921600");
+  uint64_t switchedAt = f.device.clock->millis64();
+
+  // the reconnect runs into a timeout and waits for the next attempt, far longer than the confirmation time
+  f.device.disconnect();
+  f.device.failAssociations = 1;
+  CHECK(f.improv.ConnectToWifi());
+  CHECK(f.device.clock->millis64() - switchedAt > IMPROV_CONNECT_TIMEOUT_MS);
+
+  CHECK_EQ(f.serial.baud, 115200u);
+  CHECK(f.lastSwitchAt - switchedAt <= IMPROV_BAUD_CONFIRM_MS + 100);
+}
+
+TEST(failed_switch_is_reported_at_the_new_rate)
+{
+  BaudFixture f;
+  f.failingRate = 921600;
+
+  std::vector<Frame> frames = f.setBaudRate("921600");
+
+  // acknowledgement at the old rate, then the error at the rate the host moved to
+  CHECK(frames.size() == 2 && frames[0].type == ImprovTypes::TYPE_RPC_RESPONSE);
+  CHECK(frames.size() == 2 && isError(frames[1], ImprovTypes::ERROR_UNKNOWN));
+  CHECK(f.switches == (std::vector<uint32_t>{921600, 115200}));
+  CHECK_EQ(f.serial.baud, 115200u);
+
+  // the host goes back as well, the link works without waiting for the confirmation time
+  f.serial.hostBaud = 115200;
+  frames = f.request(ImprovHost::rpc(ImprovTypes::GET_CURRENT_STATE));
+  CHECK(frames.size() == 1 && isState(frames[0], ImprovTypes::STATE_AUTHORIZED));
+
+  f.device.clock->sleep(IMPROV_BAUD_CONFIRM_MS * 2);
+  f.improv.loop();
+  CHECK_EQ(f.serial.baud, 115200u);
+  CHECK_EQ(f.switches.size(), (size_t)2);
+}
+
+TEST(lower_and_excessive_rates_are_rejected)
+{
+  BaudFixture f;
+
+  std::vector<Frame> frames = f.setBaudRate("57600");
+  CHECK(frames.size() == 1 && isError(frames[0], ImprovTypes::ERROR_INVALID_RPC));
+
+  frames = f.setBaudRate("1500000");
+  CHECK(frames.size() == 1 && isError(frames[0], ImprovTypes::ERROR_INVALID_RPC));
+
+  CHECK_EQ(f.serial.baud, 115200u);
+  CHECK(f.switches.empty());
+}
+
+// full session with a long network list, returns the virtual time it took
+static uint64_t sessionTime(bool negotiate, uint64_t &serialMs)
+{
+  BaudFixture f;
+  for (int i = 0; i < 30; i++)
+  {
+    std::string ssid = "Neighbour-Network-" + std::to_string(i);
+    f.device.addAccessPoint(ssid.c_str(), "password", 1 + i % 13, -60 - i);
+  }
+  f.device.addAccessPoint("MyNet", "secret123", 6, -50);
+
+  uint64_t start = f.device.clock->millis64();
+  if (negotiate)
+  {
+    f.setBaudRate("921600");
+    f.serial.hostBaud = 921600;
+  }
+  f.request(ImprovHost::rpc(ImprovTypes::GET_CURRENT_STATE));
+  f.request(ImprovHost::rpc(ImprovTypes::GET_DEVICE_INFO));
+  f.request(ImprovHost::rpc(ImprovTypes::GET_WIFI_NETWORKS));
+  std::vector<Frame> frames = f.request(ImprovHost::rpc(ImprovTypes::WIFI_SETTINGS, std::vector<std::string>{"MyNet", "secret123"}));
+  CHECK(!frames.empty() && frames.back().type == ImprovTypes::TYPE_RPC_RESPONSE);
+
+  uint64_t bytes = f.serial.bytesFromHost + f.serial.bytesToHost;
+  serialMs = bytes * 10000 / f.serial.baud;
+  return f.device.clock->millis64() - start;
+}
+
+TEST(session_time_115200_vs_921600)
+{
+  uint64_t slowSerial, fastSerial;
+  uint64_t slow = sessionTime(false, slowSerial);
+  uint64_t fast = sessionTime(true, fastSerial);
+
+  printf("  session at 115200: %llu ms, at 921600: %llu ms (serial ~%llu ms vs ~%llu ms)\n", (unsigned long long)slow,
+         (unsigned long long)fast, (unsigned long long)slowSerial, (unsigned long long)fastSerial);
+  CHECK(fast < slow);
+}
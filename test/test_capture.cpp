@@ -0,0 +1,134 @@
+#include <algorithm>
+
+#include "ImprovReplay.h"
+#include "ImprovTest.h"
+
+using ImprovReplay::CaptureLog;
+
+static std::vector<std::vector<uint8_t>> session()
+{
+  return {
+    ImprovHost::rpc(ImprovTypes::GET_CURRENT_STATE),
+    ImprovHost::rpc(ImprovTypes::GET_DEVICE_INFO),
+    ImprovHost::rpc(ImprovTypes::GET_WIFI_NETWORKS),
+    ImprovHost::rpc(ImprovTypes::WIFI_SETTINGS, std::vector<std::string>{"MyNet", "secret123"}),
+  };
+}
+
+static void setUp(FakeDevice &device)
+{
+  device.addAccessPoint("Office", "pw", 1, -70);
+  device.addAccessPoint("MyNet", "secret123", 6, -50);
+}
+
+TEST(reader_returns_the_records_of_the_stream)
+{
+  ImprovVirtualClock clock;
+  FakeSerial serial(&clock);
+  CaptureLog log;
+  ImprovCaptureStream capture(&serial, &log, &clock);
+
+  std::vector<uint8_t> request(IMPROV_CAPTURE_CHUNK + 10, 0xA5);
+  serial.send(request);
+  while (capture.available())
+    capture.read();
+  clock.sleep(300);
+  capture.write((const uint8_t *)"ok", 2);
+  capture.flush();
+
+  ImprovCaptureReader reader(log.data.data(), log.data.size());
+  ImprovCaptureReader::Record record;
+  std::vector<uint8_t> in;
+  while (reader.next(record) && record.direction == ImprovCaptureStream::CAPTURE_IN)
+  {
+    CHECK_EQ(record.time, 0u);
+    in.insert(in.end(), record.data, record.data + record.length);
+  }
+  CHECK(in == request);
+
+  // the delay needs a two byte varint
+  CHECK(record.direction == ImprovCaptureStream::CAPTURE_OUT);
+  CHECK_EQ(record.time, 300u);
+  CHECK(std::string((const char *)record.data, record.length) == "ok");
+  CHECK(!reader.next(record));
+  CHECK(!reader.malformed());
+}
+
+TEST(reader_rejects_malformed_captures)
+{
+  FakeDevice device;
+  setUp(device);
+  std::vector<uint8_t> capture = ImprovReplay::record(device, session(), 100);
+  ImprovCaptureReader::Record record;
+
+  std::vector<uint8_t> truncated(capture.begin(), capture.end() - 1);
+  ImprovCaptureReader reader(truncated.data(), truncated.size());
+  while (reader.next(record))
+    ;
+  CHECK(reader.malformed());
+
+  std::vector<uint8_t> header = capture;
+  header[6] = 2;
+  ImprovCaptureReader version(header.data(), header.size());
+  CHECK(!version.next(record));
+  CHECK(version.malformed());
+}
+
+TEST(replay_matches_the_recorded_session)
+{
+  FakeDevice device;
+  setUp(device);
+  std::vector<uint8_t> capture = ImprovReplay::record(device, session(), 500);
+
+  ImprovFixture f;
+  setUp(f.device);
+  ImprovReplay::Result result = ImprovReplay::replay(f, capture);
+
+  CHECK_EQ(result.records, session().size());
+  CHECK(!result.malformed);
+  CHECK(result.expected.size() >= 8);
+  CHECK(result.diffs.empty());
+  // the requests were sent at their recorded time
+  CHECK(f.device.clock->millis64() >= 3 * 500);
+}
+
+// the session with the recorded STATE_PROVISIONED changed to STATE_PROVISIONING
+static std::vector<uint8_t> tamperedCapture(bool fixChecksum)
+{
+  FakeDevice device;
+  setUp(device);
+  std::vector<uint8_t> capture = ImprovReplay::record(device, session(), 500);
+
+  std::vector<uint8_t> state = ImprovHost::frame(ImprovTypes::TYPE_CURRENT_STATE, {ImprovTypes::STATE_PROVISIONED});
+  auto at = std::search(capture.begin(), capture.end(), state.begin(), state.end());
+  CHECK(at != capture.end());
+  if (at == capture.end())
+    return capture;
+
+  // state byte and checksum
+  at[state.size() - 2] = ImprovTypes::STATE_PROVISIONING;
+  if (fixChecksum)
+    at[state.size() - 1] -= ImprovTypes::STATE_PROVISIONED - ImprovTypes::STATE_PROVISIONING;
+  return capture;
+}
+
+TEST(replay_reports_a_tampered_response)
+{
+  ImprovFixture f;
+  setUp(f.device);
+  ImprovReplay::Result result = ImprovReplay::replay(f, tamperedCapture(true));
+
+  CHECK_EQ(result.diffs.size(), 1u);
+  CHECK(!result.diffs.empty() && result.diffs[0].find("expected") == 0);
+}
+
+TEST(replay_reports_a_corrupted_frame_once)
+{
+  ImprovFixture f;
+  setUp(f.device);
+  ImprovReplay::Result result = ImprovReplay::replay(f, tamperedCapture(false));
+
+  // the recorded frame fails its checksum, the answer is extra; the rest of the session still matches
+  CHECK_EQ(result.diffs.size(), 1u);
+  CHECK(!result.diffs.empty() && result.diffs[0].find("unexpected") == 0);
+}
@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include "ImprovFixture.h"
+#include "ImprovLoopbackPeerLink.h"
+#include "ImprovPeerProvisioning.h"
+#include "ImprovTest.h"
+
+static const uint8_t FLEET_KEY[32] = {
+  0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+  0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F};
+static const uint8_t SENDER[6] = {0x24, 0x0A, 0xC4, 0x00, 0x00, 0x01};
+
+// computed independently with Python's hmac module from the layout in ImprovPeerEnvelope.h
+static const uint8_t KNOWN_ENVELOPE[80] = {
+  0x49, 0x4D, 0x50, 0x50, 0x01, 0x24, 0x0A, 0xC4, 0x00, 0x00, 0x01, 0x01, 0x02, 0x03, 0x04, 0x30,
+  0xAC, 0xB4, 0xFC, 0xF8, 0x22, 0x46, 0x67, 0x7A, 0x43, 0xAD, 0x1E, 0x8B, 0x13, 0x21, 0x34, 0xD5,
+  0xF5, 0x9D, 0x72, 0x2D, 0x02, 0x7B, 0xE2, 0x1C, 0x0F, 0x72, 0xE6, 0x14, 0x19, 0x64, 0x74, 0x67,
+  0xDE, 0x15, 0x0B, 0xC8, 0x9E, 0x2C, 0x78, 0xE7, 0xA1, 0xA0, 0xC8, 0x71, 0x5D, 0x23, 0x28, 0x89,
+  0xE4, 0xC7, 0x71, 0x7B, 0xC3, 0x03, 0xBF, 0x17, 0xF7, 0x04, 0x6F, 0xA0, 0x30, 0x5F, 0x41, 0x77};
+
+static bool openEnvelope(ImprovPeerEnvelope &envelope, const uint8_t *data, size_t length)
+{
+  uint8_t sender[6];
+  uint32_t id;
+  char ssid[33], password[65];
+  return envelope.open(data, length, sender, id, ssid, password);
+}
+
+TEST(envelope_known_answer)
+{
+  ImprovPeerEnvelope envelope;
+  CHECK(envelope.setKey(FLEET_KEY, sizeof(FLEET_KEY)));
+
+  // the credentials take two keystream blocks
+  uint8_t sealed[ImprovPeerEnvelope::MAX_LENGTH];
+  size_t length = envelope.seal(SENDER, 0x01020304, "Production-Line-07", "correct horse battery staple", sealed);
+  CHECK_EQ(length, sizeof(KNOWN_ENVELOPE));
+  CHECK(length == sizeof(KNOWN_ENVELOPE) && memcmp(sealed, KNOWN_ENVELOPE, length) == 0);
+
+  uint8_t sender[6];
+  uint32_t id;
+  char ssid[33], password[65];
+  CHECK(envelope.open(KNOWN_ENVELOPE, sizeof(KNOWN_ENVELOPE), sender, id, ssid, password));
+  CHECK(memcmp(sender, SENDER, 6) == 0);
+  CHECK_EQ(id, 0x01020304u);
+  CHECK(strcmp(ssid, "Production-Line-07") == 0);
+  CHECK(strcmp(password, "correct horse battery staple") == 0);
+}
+
+TEST(envelope_rejects_tampering)
+{
+  ImprovPeerEnvelope envelope;
+  envelope.setKey(FLEET_KEY, sizeof(FLEET_KEY));
+  uint8_t data[sizeof(KNOWN_ENVELOPE)];
+
+  // every single bit of header, ciphertext and tag
+  unsigned accepted = 0;
+  for (size_t i = 0; i < sizeof(data) * 8; i++)
+  {
+    memcpy(data, KNOWN_ENVELOPE, sizeof(data));
+    data[i / 8] ^= 1 << (i % 8);
+    accepted += openEnvelope(envelope, data, sizeof(data));
+  }
+  CHECK_EQ(accepted, 0u);
+
+  CHECK(!openEnvelope(envelope, KNOWN_ENVELOPE, sizeof(KNOWN_ENVELOPE) - 1));
+
+  ImprovPeerEnvelope other;
+  uint8_t otherKey[32];
+  memcpy(otherKey, FLEET_KEY, sizeof(otherKey));
+  otherKey[31] ^= 1;
+  other.setKey(otherKey, sizeof(otherKey));
+  CHECK(!openEnvelope(other, KNOWN_ENVELOPE, sizeof(KNOWN_ENVELOPE)));
+
+  CHECK(!envelope.setKey(FLEET_KEY, 15));
+}
+
+// one device of the fleet: radio and flash, ImprovWiFi and its peer provisioning on a loopback link
+struct PeerNode
+{
+  FakeDevice device;
+  FakeSerial serial;
+  ImprovWiFi improv;
+  ImprovLoopbackPeerLink link;
+  ImprovPeerProvisioning peers;
+  uint64_t connectedAt = 0;
+
+  PeerNode(ImprovLoopbackBus &bus, unsigned index, bool relay)
+      : serial(device.clock), improv(&serial), link(bus), peers(improv, device.clock)
+  {
+    device.select();
+    device.mac[4] = index >> 8;
+    device.mac[5] = index;
+    device.addAccessPoint("Line-AP", "production-line-7", 6, -50);
+    improv.setClock(device.clock);
+    improv.onImprovConnected([this](const char *, const char *) {
+      if (!connectedAt)
+        connectedAt = device.clock->millis64();
+    });
+    peers.begin(&link, FLEET_KEY, sizeof(FLEET_KEY), relay);
+  }
+
+  // catch up with the fleet time, then one pass of the sketch loop
+  void step(uint64_t time)
+  {
+    device.select();
+    if (device.clock->millis64() < time)
+      device.clock->sleep(time - device.clock->millis64());
+    improv.loop();
+    peers.loop();
+  }
+};
+
+struct FanOut
+{
+  unsigned provisioned = 0;
+  uint64_t p50 = 0, last = 0;
+  uint32_t broadcasts = 0;
+};
+
+// provisions node 0 over serial and runs the fleet until every node connected or a minute passed
+static FanOut fanOut(unsigned count, bool relay)
+{
+  ImprovLoopbackBus bus;
+  std::vector<std::unique_ptr<PeerNode>> nodes;
+  for (unsigned i = 0; i < count; i++)
+    nodes.push_back(std::make_unique<PeerNode>(bus, i, relay));
+
+  PeerNode &first = *nodes[0];
+  first.device.select();
+  first.serial.send(ImprovHost::rpc(ImprovTypes::WIFI_SETTINGS, std::vector<std::string>{"Line-AP", "production-line-7"}));
+  first.improv.loop();
+  uint64_t start = first.device.clock->millis64();
+
+  FanOut result;
+  for (uint64_t time = start; time < start + 60000 && result.provisioned < count; time += 50)
+  {
+    result.provisioned = 0;
+    for (auto &node : nodes)
+    {
+      node->step(time);
+      result.provisioned += node->connectedAt != 0;
+    }
+  }
+
+  std::vector<uint64_t> times;
+  for (auto &node : nodes)
+  {
+    if (node.get() != &first && node->connectedAt)
+      times.push_back(node->connectedAt - start);
+  }
+  std::sort(times.begin(), times.end());
+  if (!times.empty())
+  {
+    result.p50 = times[times.size() / 2];
+    result.last = times.back();
+  }
+  result.broadcasts = bus.packets;
+  return result;
+}
+
+TEST(credentials_fan_out_to_100_nodes)
+{
+  FanOut relayed = fanOut(100, true);
+  printf("  100 nodes with relay: p50 %llu ms, last %llu ms, %u broadcasts\n", (unsigned long long)relayed.p50,
+         (unsigned long long)relayed.last, relayed.broadcasts);
+  CHECK_EQ(relayed.provisioned, 100u);
+
+  // all nodes hear the first one, without relay it only takes longer through the rate limit
+  FanOut direct = fanOut(100, false);
+  printf("  100 nodes without relay: p50 %llu ms, last %llu ms, %u broadcasts\n", (unsigned long long)direct.p50,
+         (unsigned long long)direct.last, direct.broadcasts);
+  CHECK_EQ(direct.provisioned, 100u);
+  CHECK(direct.broadcasts < relayed.broadcasts);
+}
+
+TEST(provisioned_nodes_ignore_envelopes)
+{
+  ImprovLoopbackBus bus;
+  PeerNode sender(bus, 1, true);
+  PeerNode receiver(bus, 2, true);
+  receiver.device.addAccessPoint("Other-AP", "other-password", 1, -40);
+
+  receiver.device.select();
+  receiver.serial.send(ImprovHost::rpc(ImprovTypes::WIFI_SETTINGS, std::vector<std::string>{"Other-AP", "other-password"}));
+  receiver.improv.loop();
+  sender.device.select();
+  sender.serial.send(ImprovHost::rpc(ImprovTypes::WIFI_SETTINGS, std::vector<std::string>{"Line-AP", "production-line-7"}));
+  sender.improv.loop();
+
+  uint64_t time = std::max(sender.device.clock->millis64(), receiver.device.clock->millis64());
+  for (int i = 0; i < 40; i++, time += 50)
+  {
+    sender.step(time);
+    receiver.step(time);
+  }
+  CHECK(bus.packets > 0);
+  CHECK(receiver.device.ap() && receiver.device.ap()->ssid == "Other-AP");
+}
+
+TEST(share_needs_a_connection)
+{
+  ImprovLoopbackBus bus;
+  PeerNode node(bus, 1, true);
+  CHECK(!node.peers.share());
+
+  node.serial.send(ImprovHost::rpc(ImprovTypes::WIFI_SETTINGS, std::vector<std::string>{"Line-AP", "production-line-7"}));
+  node.step(node.device.clock->millis64());
+  CHECK(node.peers.share());
+}
@@ -0,0 +1,248 @@
+#include <cstring>
+
+#include "ImprovFixture.h"
+#include "ImprovTest.h"
+
+static std::vector<uint8_t> wifiSettings(const char *ssid, const char *password)
+{
+  return ImprovHost::rpc(ImprovTypes::WIFI_SETTINGS, std::vector<std::string>{ssid, password});
+}
+
+// credentials as stored by versions before the A/B records
+static void storeLegacyCredentials(FakeDevice &device, const char *ssid, const char *password)
+{
+#if defined(ARDUINO_ARCH_ESP8266)
+  std::fill(device.eeprom.begin(), device.eeprom.begin() + 96, 0);
+  memcpy(&device.eeprom[0], ssid, strlen(ssid) + 1);
+  memcpy(&device.eeprom[32], password, strlen(password) + 1);
+#else
+  device.nvs["wifi/ssid"].assign(ssid, ssid + strlen(ssid) + 1);
+  device.nvs["wifi/password"].assign(password, password + strlen(password) + 1);
+#endif
+}
+
+// boots a new instance on the flash of the device, returns the SSID it connected to
+static std::string reboot(FakeDevice &device)
+{
+  device.disconnect();
+  device.fsMounted = false;
+  FakeSerial serial(device.clock);
+  ImprovWiFi rebooted(&serial);
+  rebooted.setClock(device.clock);
+  if (!rebooted.ConnectToWifi() || !device.ap())
+    return "";
+  return device.ap()->ssid;
+}
+
+// saves "New" over the credentials set up by `prepare`, with the power cut after every possible storage
+// operation; after the reboot the device has to find the old or the new credentials, never none
+static void checkPowerCuts(void (*prepare)(ImprovFixture &f))
+{
+  bool completed = false;
+  for (int cutAfter = 0; cutAfter < 20 && !completed; cutAfter++)
+  {
+    ImprovFixture f;
+    f.device.addAccessPoint("Old", "old-password", 1, -50);
+    f.device.addAccessPoint("New", "new-password", 6, -50);
+    f.improv.setWriteBehindPersistence(true);
+    prepare(f);
+
+    f.device.flashEraseMs = 40;
+    f.device.flashWriteMs = 10;
+    f.device.powerFailAfter = cutAfter;
+    bool cut = false;
+    try
+    {
+      f.request(wifiSettings("New", "new-password"));
+    }
+    catch (const FakePowerFail &)
+    {
+      cut = true;
+    }
+    f.device.powerFailAfter = -1;
+    completed = !cut;
+
+    std::string ssid = reboot(f.device);
+    if (cut)
+    {
+      if (ssid != "Old" && ssid != "New")
+        printf("  power cut after %d operations lost the credentials\n", cutAfter);
+      CHECK(ssid == "Old" || ssid == "New");
+    }
+    else
+    {
+      CHECK_EQ(f.improv.getPersistStatus(), ImprovTypes::PERSIST_DONE);
+      CHECK(ssid == "New");
+    }
+  }
+  CHECK(completed);
+}
+
+TEST(power_cut_keeps_a_record)
+{
+  checkPowerCuts([](ImprovFixture &f) {
+    f.request(wifiSettings("Old", "old-password"));
+    CHECK_EQ(f.improv.getPersistStatus(), ImprovTypes::PERSIST_DONE);
+  });
+}
+
+TEST(power_cut_during_migration_keeps_the_legacy_credentials)
+{
+  checkPowerCuts([](ImprovFixture &f) { storeLegacyCredentials(f.device, "Old", "old-password"); });
+}
+
+TEST(write_behind_answers_before_the_flash_write)
+{
+  std::vector<uint8_t> frame = wifiSettings("MyNet", "secret123");
+  uint64_t elapsed[2];
+
+  for (int writeBehind = 0; writeBehind < 2; writeBehind++)
+  {
+    ImprovFixture f;
+    f.device.addAccessPoint("MyNet", "secret123", 6, -50);
+    f.improv.setWriteBehindPersistence(writeBehind);
+    f.device.flashEraseMs = 400;
+    f.device.flashWriteMs = 100;
+
+    uint64_t start = f.device.clock->millis64();
+    f.improv.handleBuffer(frame.data(), frame.size());
+    elapsed[writeBehind] = f.device.clock->millis64() - start;
+    CHECK(ImprovHost::strings(ImprovHost::parse(f.serial.take()).back()) == std::vector<std::string>{"http://192.168.1.100"});
+
+    CHECK_EQ(f.improv.getPersistStatus(), writeBehind ? ImprovTypes::PERSIST_PENDING : ImprovTypes::PERSIST_DONE);
+    f.improv.loop();
+    CHECK_EQ(f.improv.getPersistStatus(), ImprovTypes::PERSIST_DONE);
+  }
+
+  CHECK(elapsed[0] >= elapsed[1] + 100);
+}
+
+TEST(accepted_credentials_are_used_before_they_are_saved)
+{
+  ImprovFixture f;
+  f.device.addAccessPoint("Old", "old-password", 1, -50);
+  f.device.addAccessPoint("New", "new-password", 6, -50);
+  f.improv.setWriteBehindPersistence(true);
+  f.request(wifiSettings("Old", "old-password"));
+
+  // the link drops before loop() wrote the new credentials
+  std::vector<uint8_t> frame = wifiSettings("New", "new-password");
+  f.improv.handleBuffer(frame.data(), frame.size());
+  CHECK_EQ(f.improv.getPersistStatus(), ImprovTypes::PERSIST_PENDING);
+  f.device.disconnect();
+  CHECK(f.improv.ConnectToWifi());
+  CHECK(f.device.ap() && f.device.ap()->ssid == "New");
+}
+
+TEST(failed_save_keeps_the_credentials_in_ram)
+{
+  ImprovFixture f;
+  f.device.addAccessPoint("MyNet", "secret123", 6, -50);
+  std::vector<ImprovTypes::Error> errors;
+  f.improv.onImprovError([&errors](ImprovTypes::Error error) { errors.push_back(error); });
+  f.improv.setCustomWiFiCredentialSaving([](std::string *, std::string *) { return false; });
+  f.improv.setWriteBehindPersistence(true);
+
+  f.request(wifiSettings("MyNet", "secret123"));
+  f.improv.loop();
+  CHECK_EQ(f.improv.getPersistStatus(), ImprovTypes::PERSIST_FAILED);
+  CHECK(errors == std::vector<ImprovTypes::Error>{ImprovTypes::ERROR_CREDENTIALS_NOT_SAVED});
+  CHECK(f.improv.hasCredentials());
+
+  // the reconnect of loop() still knows the network
+  f.device.disconnect();
+  f.improv.loop();
+  CHECK(f.device.ap() && f.device.ap()->ssid == "MyNet");
+}
+
+#if defined(ARDUINO_ARCH_ESP8266)
+
+TEST(littlefs_saves_do_not_erase_the_eeprom_sector)
+{
+  ImprovFixture f;
+  f.device.addAccessPoint("MyNet", "secret123", 6, -50);
+
+  f.request(wifiSettings("MyNet", "secret123"));
+  f.request(wifiSettings("MyNet", "secret123"));
+
+  CHECK_EQ(f.device.sectorErases, 0u);
+  CHECK(f.device.files.count("/improv.cred0") && f.device.files.count("/improv.cred1"));
+  CHECK(reboot(f.device) == "MyNet");
+}
+
+TEST(legacy_credentials_are_cleared_once)
+{
+  ImprovFixture f;
+  f.device.addAccessPoint("MyNet", "secret123", 6, -50);
+  storeLegacyCredentials(f.device, "Old", "old-password");
+
+  f.request(wifiSettings("MyNet", "secret123"));
+  f.request(wifiSettings("MyNet", "secret123"));
+
+  CHECK_EQ(f.device.sectorErases, 1u);
+  CHECK(reboot(f.device) == "MyNet");
+}
+
+TEST(erased_eeprom_holds_no_legacy_credentials)
+{
+  FakeDevice device;
+  device.select();
+  device.fsFormatted = false;
+  device.addAccessPoint("MyNet", "secret123", 6, -50);
+
+  FakeSerial serial(device.clock);
+  ImprovWiFi improv(&serial);
+  improv.setClock(device.clock);
+  CHECK(!improv.ConnectToWifi());
+  CHECK(!improv.hasCredentials());
+  CHECK_EQ(device.begins, 0u);
+}
+
+TEST(legacy_ssid_of_full_length_is_not_terminated)
+{
+  ImprovFixture f;
+  const char *ssid = "Thirty-Two-Characters-Long-SSID!";
+  f.device.addAccessPoint(ssid, "secret123", 6, -50);
+  // the SSID fills its field, the password follows without a NUL in between
+  std::fill(f.device.eeprom.begin(), f.device.eeprom.begin() + 96, 0);
+  memcpy(&f.device.eeprom[0], ssid, 32);
+  memcpy(&f.device.eeprom[32], "secret123", 10);
+
+  CHECK(reboot(f.device) == ssid);
+}
+
+TEST(without_littlefs_the_eeprom_sector_is_used_unformatted)
+{
+  ImprovFixture f;
+  f.device.fsFormatted = false;
+  f.device.addAccessPoint("MyNet", "secret123", 6, -50);
+  storeLegacyCredentials(f.device, "Old", "old-password");
+
+  f.request(wifiSettings("MyNet", "secret123"));
+
+  // one commit for the record and the removal of the old layout
+  CHECK_EQ(f.device.sectorErases, 1u);
+  CHECK(!f.device.fsFormatted);
+  CHECK(f.device.files.empty());
+  CHECK(reboot(f.device) == "MyNet");
+}
+
+TEST(lease_cache_does_not_commit_the_eeprom_sector)
+{
+  for (int formatted = 0; formatted < 2; formatted++)
+  {
+    ImprovFixture f;
+    f.device.fsFormatted = formatted;
+    f.device.addAccessPoint("MyNet", "secret123", 6, -50);
+    f.improv.enableLeaseCache();
+
+    f.request(wifiSettings("MyNet", "secret123"));
+    f.improv.loop();
+
+    // only the credential record commits the sector if there is no file system
+    CHECK_EQ(f.device.sectorErases, formatted ? 0u : 1u);
+    CHECK_EQ(f.device.files.count("/improv.lease"), formatted ? 1u : 0u);
+  }
+}
+
+#endif
@@ -0,0 +1,385 @@
+#include "ImprovFixture.h"
+#include "ImprovTest.h"
+
+using ImprovHost::Frame;
+
+TEST(wifi_settings_provision_and_persist)
+{
+  ImprovFixture f;
+  f.device.addAccessPoint("MyNet", "secret123", 6, -50);
+
+  std::vector<Frame> frames = f.request(ImprovHost::rpc(ImprovTypes::WIFI_SETTINGS, std::vector<std::string>{"MyNet", "secret123"}));
+
+  CHECK(frames.size() >= 3);
+  CHECK(isState(frames[0], ImprovTypes::STATE_PROVISIONING));
+  CHECK(frames.size() >= 3 && isState(frames[frames.size() - 2], ImprovTypes::STATE_PROVISIONED));
+  CHECK(frames.back().type == ImprovTypes::TYPE_RPC_RESPONSE);
+  CHECK(ImprovHost::strings(frames.back()) == std::vector<std::string>{"http://192.168.1.100"});
+  CHECK(f.improv.isConnected());
+  CHECK_EQ(f.improv.getPersistStatus(), ImprovTypes::PERSIST_DONE);
+
+  // a rebooted device finds the credentials again
+  f.device.disconnect();
+  FakeSerial serial(f.device.clock);
+  ImprovWiFi rebooted(&serial);
+  rebooted.setClock(f.device.clock);
+  CHECK(rebooted.ConnectToWifi());
+  CHECK(f.device.ap() && f.device.ap()->ssid == "MyNet");
+}
+
+TEST(wrong_password_is_reported)
+{
+  ImprovFixture f;
+  f.device.addAccessPoint("MyNet", "secret123", 6, -50);
+
+  std::vector<Frame> frames = f.request(ImprovHost::rpc(ImprovTypes::WIFI_SETTINGS, std::vector<std::string>{"MyNet", "wrong-password"}));
+
+  CHECK(frames.size() == 3);
+  CHECK(frames.size() == 3 && isState(frames[1], ImprovTypes::STATE_STOPPED));
+  CHECK(frames.size() == 3 && isError(frames[2], ImprovTypes::ERROR_UNABLE_TO_CONNECT));
+  CHECK(!f.improv.isConnected());
+  CHECK_EQ(f.improv.getPersistStatus(), ImprovTypes::PERSIST_IDLE);
+}
+
+TEST(malformed_wifi_settings_are_rejected)
+{
+  ImprovFixture f;
+
+  // ssid length reaches behind the payload
+  std::vector<Frame> frames = f.request(ImprovHost::rpc(ImprovTypes::WIFI_SETTINGS, std::vector<uint8_t>{20, 'A', 'B', 0}));
+
+  CHECK_EQ(frames.size(), 1u);
+  CHECK(frames.size() == 1 && isError(frames[0], ImprovTypes::ERROR_INVALID_RPC));
+  CHECK_EQ(f.device.begins, 0u);
+}
+
+// sends WIFI_SETTINGS which has to fail, returns the virtual time until the error frame
+static uint64_t timeToError(ImprovFixture &f, const char *ssid, const char *password)
+{
+  uint64_t start = f.device.clock->millis64();
+  std::vector<Frame> frames = f.request(ImprovHost::rpc(ImprovTypes::WIFI_SETTINGS, std::vector<std::string>{ssid, password}));
+  uint64_t elapsed = f.device.clock->millis64() - start;
+
+  CHECK(!frames.empty() && isError(frames.back(), ImprovTypes::ERROR_UNABLE_TO_CONNECT));
+  CHECK(frames.size() >= 2 && isState(frames[frames.size() - 2], ImprovTypes::STATE_STOPPED));
+  CHECK(!f.improv.isConnected());
+  // a timeout would take all the attempts
+  CHECK(elapsed < MAX_ATTEMPTS_WIFI_CONNECTION * DELAY_MS_WAIT_WIFI_CONNECTION / 2);
+  return elapsed;
+}
+
+TEST(unknown_ssid_fails_fast)
+{
+  ImprovFixture f;
+  f.device.addAccessPoint("MyNet", "secret123", 6, -50);
+
+  timeToError(f, "OtherNet", "secret123");
+  CHECK_EQ(f.device.begins, 0u);
+}
+
+TEST(password_for_an_open_network_fails_fast)
+{
+  ImprovFixture f;
+  f.device.addAccessPoint("Cafe", "", 1, -50);
+
+  // answered from the network list, without touching the radio
+  f.request(ImprovHost::rpc(ImprovTypes::GET_WIFI_NETWORKS));
+  uint64_t scans = f.device.scans;
+  CHECK(timeToError(f, "Cafe", "secret123") < 100);
+  CHECK_EQ(f.device.scans, scans);
+  CHECK_EQ(f.device.begins, 0u);
+}
+
+TEST(missing_password_for_a_secured_network_fails_fast)
+{
+  ImprovFixture f;
+  f.device.addAccessPoint("MyNet", "secret123", 6, -50);
+
+  timeToError(f, "MyNet", "");
+  CHECK_EQ(f.device.begins, 0u);
+}
+
+TEST(wrong_password_fails_fast)
+{
+  ImprovFixture f;
+  f.device.addAccessPoint("MyNet", "secret123", 6, -50);
+
+  // rejected by the AP: WL_WRONG_PASSWORD on ESP8266, a disconnect with WIFI_REASON_AUTH_FAIL on ESP32
+  uint64_t elapsed = timeToError(f, "MyNet", "wrong-password");
+  CHECK_EQ(f.device.begins, 1u);
+  // the probe, the channel scan of WiFi.begin(), the association; the failure is seen at the first or second poll
+  CHECK(elapsed <= 2 * 14 * f.device.scanMsPerChannel + f.device.associateMs + 2 * DELAY_MS_WAIT_WIFI_CONNECTION);
+}
+
+TEST(failed_scan_sends_an_empty_network_list)
+{
+  ImprovFixture f;
+  f.device.addAccessPoint("MyNet", "secret123", 6, -50);
+  f.device.failScans = 2;
+
+  std::vector<Frame> frames = f.request(ImprovHost::rpc(ImprovTypes::GET_WIFI_NETWORKS));
+  CHECK_EQ(frames.size(), 1u);
+  CHECK(frames.size() == 1 && ImprovHost::strings(frames[0]).empty());
+
+  // the failed scan leaves no cache behind, WIFI_SETTINGS probes for the network
+  uint64_t scans = f.device.scans;
+  frames = f.request(ImprovHost::rpc(ImprovTypes::WIFI_SETTINGS, std::vector<std::string>{"MyNet", "secret123"}));
+  CHECK(f.improv.isConnected());
+  CHECK_EQ(f.device.scans, scans + 1);
+}
+
+TEST(device_info_and_state)
+{
+  ImprovFixture f;
+
+  std::vector<Frame> frames = f.request(ImprovHost::rpc(ImprovTypes::GET_DEVICE_INFO));
+  CHECK_EQ(frames.size(), 1u);
+  CHECK(frames.size() == 1 && ImprovHost::strings(frames[0]) == (std::vector<std::string>{"HostTest", "1.0.0", "ESP32", "Fixture"}));
+
+  frames = f.request(ImprovHost::rpc(ImprovTypes::GET_CURRENT_STATE));
+  CHECK_EQ(frames.size(), 1u);
+  CHECK(frames.size() == 1 && isState(frames[0], ImprovTypes::STATE_AUTHORIZED));
+
+  frames = f.request(ImprovHost::rpc(0xE0));
+  CHECK(frames.size() == 1 && isError(frames[0], ImprovTypes::ERROR_UNKNOWN_RPC));
+}
+
+TEST(compact_network_list_uses_the_wire_auth)
+{
+  ImprovFixture f;
+  f.device.addAccessPoint("open", "", 1, -40);
+  f.device.addAccessPoint("wep", "pw", 1, -45, FAKE_AUTH_WEP);
+  f.device.addAccessPoint("wpa", "pw", 1, -50, FAKE_AUTH_WPA_PSK);
+  f.device.addAccessPoint("wpa2", "pw", 1, -55, FAKE_AUTH_WPA2_PSK);
+  f.device.addAccessPoint("wpa-wpa2", "pw", 1, -60, FAKE_AUTH_WPA_WPA2_PSK);
+  f.device.addAccessPoint("enterprise", "pw", 1, -65, FAKE_AUTH_WPA2_ENTERPRISE);
+  f.device.addAccessPoint("wpa3", "pw", 1, -70, FAKE_AUTH_WPA3_PSK);
+
+  std::vector<Frame> frames = f.request(ImprovHost::rpc(ImprovTypes::GET_WIFI_NETWORKS, std::vector<uint8_t>{ImprovTypes::NETWORK_LIST_COMPACT}));
+
+  // records: ssid length, ssid, rssi, channel, auth, bssid
+  std::vector<uint8_t> auth;
+  for (const Frame &frame : frames)
+  {
+    for (size_t i = 2; i < frame.payload.size(); i += 1 + frame.payload[i] + 9)
+      auth.push_back(frame.payload[i + 1 + frame.payload[i] + 2]);
+  }
+
+#if defined(ARDUINO_ARCH_ESP8266)
+  std::vector<uint8_t> expected = {ImprovTypes::AUTH_OPEN, ImprovTypes::AUTH_WEP, ImprovTypes::AUTH_WPA_PSK, ImprovTypes::AUTH_WPA2_PSK,
+                                   ImprovTypes::AUTH_WPA_WPA2_PSK, ImprovTypes::AUTH_OTHER, ImprovTypes::AUTH_OTHER};
+#else
+  std::vector<uint8_t> expected = {ImprovTypes::AUTH_OPEN, ImprovTypes::AUTH_WEP, ImprovTypes::AUTH_WPA_PSK, ImprovTypes::AUTH_WPA2_PSK,
+                                   ImprovTypes::AUTH_WPA_WPA2_PSK, ImprovTypes::AUTH_WPA2_ENTERPRISE, ImprovTypes::AUTH_WPA3_PSK};
+#endif
+  CHECK(auth == expected);
+}
+
+// provisioned device, rebooted with a new instance on the same flash
+struct RebootFixture : ImprovFixture
+{
+  FakeSerial rebootSerial;
+  ImprovWiFi rebooted;
+
+  explicit RebootFixture(bool leaseCache, uint32_t leaseSeconds = 86400) : rebootSerial(device.clock), rebooted(&rebootSerial)
+  {
+    device.dhcpLeaseSeconds = leaseSeconds;
+    device.addAccessPoint("Other", "pw", 1, -40);
+    device.addAccessPoint("MyNet", "secret123", 6, -50);
+    if (leaseCache)
+    {
+      improv.enableLeaseCache();
+      rebooted.enableLeaseCache();
+    }
+    request(ImprovHost::rpc(ImprovTypes::WIFI_SETTINGS, std::vector<std::string>{"MyNet", "secret123"}));
+    improv.loop();
+
+    rebooted.setClock(device.clock);
+    device.disconnect();
+    device.scans = 0;
+    device.begins = 0;
+  }
+};
+
+TEST(first_connect_after_boot_does_not_probe)
+{
+  RebootFixture f(true);
+
+  uint64_t start = f.device.clock->millis64();
+  CHECK(f.rebooted.ConnectToWifi());
+
+  // straight to the AP and channel of the cached lease
+  CHECK_EQ(f.device.scans, 0u);
+  CHECK_EQ(f.device.begins, 1u);
+  CHECK_EQ(f.device.beginChannel, 6);
+  CHECK(f.device.beginWithBssid);
+  CHECK(f.device.clock->millis64() - start < 14 * f.device.scanMsPerChannel);
+}
+
+TEST(first_connect_without_lease_cache_does_not_probe)
+{
+  RebootFixture f(false);
+
+  CHECK(f.rebooted.ConnectToWifi());
+  CHECK_EQ(f.device.scans, 0u);
+  CHECK_EQ(f.device.begins, 1u);
+  CHECK_EQ(f.device.beginChannel, 0);
+}
+
+TEST(retry_probes_for_a_moved_network)
+{
+  RebootFixture f(true);
+  f.device.accessPoints[1].channel = 11;
+
+  CHECK(f.rebooted.ConnectToWifi());
+  CHECK_EQ(f.device.begins, 2u);
+  CHECK(f.device.scans > 0);
+  CHECK_EQ(f.device.beginChannel, 11);
+}
+
+// runs the loop of the rebooted device past the lease check, true if it had an address all the time
+static bool runLeaseCheck(RebootFixture &f)
+{
+  bool reachable = true;
+  for (uint32_t t = 0; t < IMPROV_LEASE_VALIDATE_DELAY_MS + 3 * IMPROV_LEASE_VALIDATE_TIMEOUT_MS; t += 100)
+  {
+    f.rebooted.loop();
+    reachable &= (uint32_t)WiFi.localIP() != 0;
+    f.device.clock->sleep(100);
+  }
+  return reachable;
+}
+
+TEST(cached_lease_is_probed_without_dropping_the_address)
+{
+  RebootFixture f(true);
+  CHECK(f.rebooted.ConnectToWifi());
+  CHECK(f.device.staticConfig);
+
+  CHECK(runLeaseCheck(f));
+  CHECK_EQ(f.device.dhcpRestarts, 0u);
+  CHECK(f.device.staticConfig);
+  // gratuitous ARP for the own address, request for the gateway
+  CHECK(f.device.arpRequests == (std::vector<uint32_t>{f.device.dhcpIp, f.device.dhcpGateway}));
+}
+
+TEST(unanswered_gateway_falls_back_to_dhcp)
+{
+  RebootFixture f(true);
+  // the network was renumbered while the device was off
+  f.device.dhcpIp = 0x3200000A;
+  f.device.dhcpGateway = 0x0100000A;
+  CHECK(f.rebooted.ConnectToWifi());
+
+  runLeaseCheck(f);
+  CHECK_EQ(f.device.dhcpRestarts, 1u);
+  CHECK_EQ((uint32_t)WiFi.localIP(), 0x3200000Au);
+
+  // the next boot uses the new lease
+  f.device.disconnect();
+  FakeSerial serial(f.device.clock);
+  ImprovWiFi again(&serial);
+  again.setClock(f.device.clock);
+  again.enableLeaseCache();
+  CHECK(again.ConnectToWifi());
+  CHECK(f.device.staticConfig && f.device.ip == 0x3200000Au);
+}
+
+TEST(address_conflict_falls_back_to_dhcp)
+{
+  RebootFixture f(true);
+  // another host got the address while the device was off
+  f.device.conflictIp = f.device.dhcpIp;
+  f.device.dhcpIp = 0x6501A8C0;
+  CHECK(f.rebooted.ConnectToWifi());
+
+  runLeaseCheck(f);
+  CHECK_EQ(f.device.dhcpRestarts, 1u);
+  CHECK_EQ((uint32_t)WiFi.localIP(), 0x6501A8C0u);
+}
+
+// runs the loop of the rebooted device in steps of one second, returns the time until it went back to DHCP
+static uint64_t timeToDhcp(RebootFixture &f, uint64_t limitMs)
+{
+  uint64_t start = f.device.clock->millis64();
+  while (f.device.dhcpRestarts == 0 && f.device.clock->millis64() - start < limitMs)
+  {
+    f.rebooted.loop();
+    f.device.clock->sleep(1000);
+  }
+  return f.device.clock->millis64() - start;
+}
+
+TEST(cached_lease_goes_back_to_dhcp_before_it_expires)
+{
+  // ten minutes of lease time: DHCP takes over at T1
+  RebootFixture f(true, 600);
+  CHECK(f.rebooted.ConnectToWifi());
+  CHECK(f.device.staticConfig);
+
+  uint64_t elapsed = timeToDhcp(f, 3600000);
+  CHECK(elapsed >= 300000 && elapsed <= 302000);
+  CHECK_EQ(f.device.dhcpRestarts, 1u);
+
+  // the new lease is stored and not handed over again
+  timeToDhcp(f, 10000);
+  CHECK(!f.device.staticConfig);
+  CHECK_EQ((uint32_t)WiFi.localIP(), f.device.dhcpIp);
+  f.device.dhcpRestarts = 0;
+  CHECK(timeToDhcp(f, 3600000) >= 3600000);
+}
+
+TEST(long_cached_lease_is_used_up_to_the_limit)
+{
+  // a day of lease time, capped at IMPROV_LEASE_RENEW_MAX_MS
+  RebootFixture f(true, 86400);
+  CHECK(f.rebooted.ConnectToWifi());
+
+  uint64_t elapsed = timeToDhcp(f, 2 * IMPROV_LEASE_RENEW_MAX_MS);
+  CHECK(elapsed >= IMPROV_LEASE_RENEW_MAX_MS && elapsed <= IMPROV_LEASE_RENEW_MAX_MS + 2000);
+  CHECK_EQ(f.device.dhcpRestarts, 1u);
+}
+
+TEST(reconnects_give_up_after_the_last_retry)
+{
+  ImprovFixture f;
+  f.device.addAccessPoint("MyNet", "secret123", 6, -50);
+  f.request(ImprovHost::rpc(ImprovTypes::WIFI_SETTINGS, std::vector<std::string>{"MyNet", "secret123"}));
+  f.improv.loop();
+  std::vector<ImprovTypes::Error> errors;
+  f.improv.onImprovError([&errors](ImprovTypes::Error error) { errors.push_back(error); });
+
+  // the AP is switched off for good
+  f.device.accessPoints.clear();
+  f.device.disconnect();
+  uint32_t begins = f.device.begins;
+  uint32_t scans = f.device.scans;
+  uint64_t start = f.device.clock->millis64();
+  f.improv.loop();
+  uint64_t elapsed = f.device.clock->millis64() - start;
+
+  // one attempt per IMPROV_RECONNECT_INTERVAL_MS, the last one probes and waits for the connect timeout
+  uint64_t lastAttempt = (IMPROV_MAX_CONNECT_RETRIES - 1) * (uint64_t)IMPROV_RECONNECT_INTERVAL_MS;
+  CHECK(elapsed >= lastAttempt + IMPROV_CONNECT_TIMEOUT_MS);
+  CHECK(elapsed <= lastAttempt + IMPROV_CONNECT_TIMEOUT_MS + 14 * f.device.scanMsPerChannel + 100);
+  // the first attempt connects without a probe, the retries probe first; from a third of them on they connect anyway
+  CHECK_EQ(f.device.scans - scans, (uint32_t)IMPROV_MAX_CONNECT_RETRIES - 1);
+  CHECK_EQ(f.device.begins - begins, 1u + IMPROV_MAX_CONNECT_RETRIES - IMPROV_MAX_CONNECT_RETRIES / 3);
+  CHECK(errors == (std::vector<ImprovTypes::Error>{ImprovTypes::ERROR_WIFI_DISCONNECTED, ImprovTypes::ERROR_UNABLE_TO_CONNECT}));
+  CHECK(!f.improv.isConnected());
+
+  // the next loop() reports the give-up and restarts without another attempt
+  begins = f.device.begins;
+  bool restarted = false;
+  try
+  {
+    f.improv.loop();
+  }
+  catch (const FakeRestart &)
+  {
+    restarted = true;
+  }
+  CHECK(restarted);
+  CHECK_EQ(f.device.begins, begins);
+  CHECK(errors.size() == 3 && errors.back() == ImprovTypes::ERROR_WIFI_CONNECT_GIVEUP);
+}
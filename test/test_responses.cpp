@@ -0,0 +1,121 @@
+#include <new>
+
+#include "ImprovFixture.h"
+#include "ImprovTest.h"
+
+static size_t allocations = 0;
+
+void *operator new(size_t size)
+{
+  allocations++;
+  if (void *p = malloc(size))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+  free(p);
+}
+
+// serial line replaying one request forever, without buffers which could allocate
+class PollingStream : public Stream
+{
+public:
+  explicit PollingStream(const std::vector<uint8_t> &request) : request(request) {}
+
+  size_t written = 0;
+  bool   pending = false;
+
+  int available() override { return pending ? request.size() - position : 0; }
+  int read() override
+  {
+    if (!pending)
+      return -1;
+    uint8_t b = request[position++];
+    if (position == request.size())
+    {
+      position = 0;
+      pending = false;
+    }
+    return b;
+  }
+  int peek() override { return pending ? request[position] : -1; }
+  size_t write(uint8_t) override { return ++written, 1; }
+  size_t write(const uint8_t *, size_t size) override { return written += size, size; }
+  using Print::write;
+
+private:
+  const std::vector<uint8_t> &request;
+  size_t position = 0;
+};
+
+using ImprovHost::Frame;
+
+static const std::vector<uint8_t> STATE_AUTHORIZED_FRAME = {'I', 'M', 'P', 'R', 'O', 'V', 0x01, 0x01, 0x01, 0x02, 0xE2};
+static const std::vector<uint8_t> ERROR_UNKNOWN_RPC_FRAME = {'I', 'M', 'P', 'R', 'O', 'V', 0x01, 0x02, 0x01, 0x02, 0xE3};
+
+TEST(state_frame_bytes)
+{
+  ImprovFixture f;
+
+  f.serial.send(ImprovHost::rpc(ImprovTypes::GET_CURRENT_STATE));
+  f.improv.loop();
+  CHECK(f.serial.take() == STATE_AUTHORIZED_FRAME);
+
+  // repeated polls answer identically
+  for (int i = 0; i < 3; i++)
+  {
+    f.serial.send(ImprovHost::rpc(ImprovTypes::GET_CURRENT_STATE));
+    f.improv.loop();
+    CHECK(f.serial.take() == STATE_AUTHORIZED_FRAME);
+  }
+}
+
+TEST(error_frame_bytes)
+{
+  ImprovFixture f;
+
+  f.serial.send(ImprovHost::rpc(0xE0));
+  f.improv.loop();
+  CHECK(f.serial.take() == ERROR_UNKNOWN_RPC_FRAME);
+}
+
+TEST(device_info_cache_follows_set_device_info)
+{
+  ImprovFixture f;
+
+  std::vector<Frame> frames = f.request(ImprovHost::rpc(ImprovTypes::GET_DEVICE_INFO));
+  CHECK(frames.size() == 1 && ImprovHost::strings(frames[0])[3] == "Fixture");
+
+  f.improv.setDeviceInfo(ImprovTypes::CF_ESP32_S3, "HostTest", "1.0.1", "Renamed");
+  frames = f.request(ImprovHost::rpc(ImprovTypes::GET_DEVICE_INFO));
+  CHECK(frames.size() == 1 && ImprovHost::strings(frames[0]) == (std::vector<std::string>{"HostTest", "1.0.1", "ESP32-S3", "Renamed"}));
+}
+
+TEST(state_polls_do_not_allocate)
+{
+  FakeDevice device;
+  device.select();
+  std::vector<uint8_t> request = ImprovHost::rpc(ImprovTypes::GET_CURRENT_STATE);
+  PollingStream serial(request);
+  ImprovWiFi improv(&serial);
+  improv.setClock(device.clock);
+
+  // warm up, then count
+  serial.pending = true;
+  improv.loop();
+  allocations = 0;
+  for (int i = 0; i < 100; i++)
+  {
+    serial.pending = true;
+    improv.loop();
+  }
+  CHECK_EQ(allocations, 0u);
+  CHECK_EQ(serial.written, 101u * 11);
+}
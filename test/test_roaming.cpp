@@ -0,0 +1,133 @@
+#include "ImprovFixture.h"
+#include "ImprovTest.h"
+
+using ImprovHost::Frame;
+
+// provisioned device connected to AP 0 ("Office" on channel 1), roaming enabled
+struct RoamingFixture : ImprovFixture
+{
+  unsigned roams = 0;
+  bool loopBlocked = false;
+
+  explicit RoamingFixture(bool secondApKnown)
+  {
+    device.addAccessPoint("Office", "secret123", 1, -50);
+    device.addAccessPoint("Lobby", "pw", 6, -55);
+    if (secondApKnown)
+      device.addAccessPoint("Office", "secret123", 11, -60);
+
+    request(ImprovHost::rpc(ImprovTypes::WIFI_SETTINGS, std::vector<std::string>{"Office", "secret123"}));
+    improv.loop();
+    improv.enableRoaming(-75, 8);
+  }
+
+  // one second of the trace: the RSSI of AP 0 (and AP 2 if given), then one loop()
+  void step(int rssi, int otherRssi = 0)
+  {
+    device.accessPoints[0].rssi = rssi;
+    if (otherRssi && device.accessPoints.size() > 2)
+      device.accessPoints[2].rssi = otherRssi;
+
+    device.clock->sleep(1000);
+    unsigned begins = device.begins;
+    uint64_t before = device.clock->millis64();
+    improv.loop();
+    loopBlocked |= device.clock->millis64() != before;
+    roams += device.begins - begins;
+  }
+
+  const FakeAccessPoint *ap() { return device.ap(); }
+};
+
+TEST(degrading_link_roams_to_a_new_ap)
+{
+  RoamingFixture f(false);
+  CHECK(f.ap() == &f.device.accessPoints[0]);
+
+  // a stronger AP of the network is installed, unknown so far
+  f.device.addAccessPoint("Office", "secret123", 11, -60);
+  uint64_t scannedChannels = f.device.scannedChannels;
+
+  for (int t = 0; t < 10; t++)
+    f.step(-50);
+  CHECK_EQ(f.roams, 0u);
+
+  int roamedAt = -1;
+  for (int t = 0; t < 30; t++)
+  {
+    f.step(-88);
+    if (roamedAt < 0 && f.roams)
+      roamedAt = t;
+  }
+
+  // the average passes -75 dBm after nine samples, the full background scan takes 1.7 s
+  CHECK(roamedAt >= 9 && roamedAt <= 12);
+  CHECK_EQ(f.roams, 1u);
+  CHECK(f.ap() == &f.device.accessPoints[2]);
+  CHECK(f.device.beginWithBssid);
+  CHECK_EQ(f.device.scannedChannels - scannedChannels, 14u);
+  CHECK(!f.loopBlocked);
+}
+
+TEST(known_channels_restrict_the_scan)
+{
+  RoamingFixture f(true);
+  CHECK(f.ap() == &f.device.accessPoints[0]);
+  uint64_t scannedChannels = f.device.scannedChannels;
+
+  for (int t = 0; t < 30; t++)
+    f.step(t < 10 ? -50 : -88);
+
+  // channels 1 and 11, seen while validating WIFI_SETTINGS
+  CHECK_EQ(f.device.scannedChannels - scannedChannels, 2u);
+  CHECK_EQ(f.roams, 1u);
+  CHECK(f.ap() == &f.device.accessPoints[2]);
+  CHECK(!f.loopBlocked);
+}
+
+TEST(hysteresis_prevents_flapping)
+{
+  RoamingFixture f(true);
+  uint64_t scans = f.device.scans;
+
+  // both APs are weak and only 4 dB apart
+  for (int t = 0; t < 200; t++)
+    f.step(-80, -76);
+
+  CHECK_EQ(f.roams, 0u);
+  CHECK(f.ap() == &f.device.accessPoints[0]);
+  // two channels per attempt, one attempt per IMPROV_ROAM_HOLDOFF_MS
+  CHECK(f.device.scans - scans <= 2 * (200000 / IMPROV_ROAM_HOLDOFF_MS + 1));
+  CHECK(!f.loopBlocked);
+
+  // the new link does not roam back either
+  RoamingFixture g(true);
+  for (int t = 0; t < 30; t++)
+    g.step(t < 10 ? -50 : -88);
+  CHECK_EQ(g.roams, 1u);
+  for (int t = 0; t < 200; t++)
+    g.step(-74, -78);
+  CHECK_EQ(g.roams, 1u);
+}
+
+TEST(network_list_waits_for_a_running_roaming_scan)
+{
+  RoamingFixture f(false);
+
+  // no stronger AP exists, the scan keeps running when the client asks for the networks
+  int t = 0;
+  while (f.device.scanComplete() != -1 && t++ < 30)
+    f.step(t < 10 ? -50 : -88);
+  CHECK(t < 30);
+
+  std::vector<Frame> frames = f.request(ImprovHost::rpc(ImprovTypes::GET_WIFI_NETWORKS));
+  std::vector<std::string> ssids;
+  for (const Frame &frame : frames)
+  {
+    std::vector<std::string> strings = ImprovHost::strings(frame);
+    if (!strings.empty())
+      ssids.push_back(strings[0]);
+  }
+  CHECK(ssids == (std::vector<std::string>{"Lobby", "Office"}));
+  CHECK_EQ(f.roams, 0u);
+}
@@ -0,0 +1,104 @@
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "ImprovFrameAssembler.h"
+#include "ImprovRpcDecoder.h"
+#include "ImprovTest.h"
+
+// payload of WIFI_SETTINGS with one spare byte behind it, as the assembler provides
+static std::vector<uint8_t> wifiSettings(const std::string &ssid, const std::string &password)
+{
+  std::vector<uint8_t> data = {ImprovTypes::WIFI_SETTINGS, (uint8_t)(2 + ssid.size() + password.size()), (uint8_t)ssid.size()};
+  data.insert(data.end(), ssid.begin(), ssid.end());
+  data.push_back(password.size());
+  data.insert(data.end(), password.begin(), password.end());
+  data.push_back(0xEE);
+  return data;
+}
+
+TEST(decodes_wifi_settings)
+{
+  std::vector<uint8_t> data = wifiSettings("MyNet", "secret123");
+  ImprovTypes::ImprovCommandView cmd;
+
+  CHECK(ImprovRpcDecoder::decode(data.data(), data.size() - 1, cmd));
+  CHECK_EQ(cmd.command, ImprovTypes::WIFI_SETTINGS);
+  CHECK_EQ(cmd.ssidLength, 5);
+  CHECK_EQ(cmd.passwordLength, 9);
+  CHECK(std::string(cmd.ssid, cmd.ssidLength) == "MyNet");
+  CHECK(std::string(cmd.password, cmd.passwordLength) == "secret123");
+  CHECK(cmd.data == data.data() + 2);
+  CHECK_EQ(cmd.dataLength, data.size() - 3);
+}
+
+TEST(decodes_empty_password)
+{
+  std::vector<uint8_t> data = wifiSettings("Open", "");
+  ImprovTypes::ImprovCommandView cmd;
+
+  CHECK(ImprovRpcDecoder::decode(data.data(), data.size() - 1, cmd));
+  CHECK_EQ(cmd.passwordLength, 0);
+  CHECK(std::string(cmd.ssid, cmd.ssidLength) == "Open");
+}
+
+TEST(rejects_lengths_beyond_the_payload)
+{
+  ImprovTypes::ImprovCommandView cmd;
+
+  // ssid length points behind the payload
+  std::vector<uint8_t> data = wifiSettings("MyNet", "pw");
+  data[2] = 40;
+  CHECK(!ImprovRpcDecoder::decode(data.data(), data.size() - 1, cmd));
+
+  // password length points behind the payload
+  data = wifiSettings("MyNet", "pw");
+  data[3 + 5] = 3;
+  CHECK(!ImprovRpcDecoder::decode(data.data(), data.size() - 1, cmd));
+
+  // data length does not match the payload
+  data = wifiSettings("MyNet", "pw");
+  data[1]++;
+  CHECK(!ImprovRpcDecoder::decode(data.data(), data.size() - 1, cmd));
+
+  // no password length at all
+  uint8_t truncated[] = {ImprovTypes::WIFI_SETTINGS, 2, 1, 'A', 0};
+  CHECK(!ImprovRpcDecoder::decode(truncated, 4, cmd));
+
+  uint8_t tooShort[] = {ImprovTypes::GET_CURRENT_STATE, 0};
+  CHECK(!ImprovRpcDecoder::decode(tooShort, 1, cmd));
+}
+
+TEST(other_commands_only_get_the_data_view)
+{
+  uint8_t data[] = {ImprovTypes::GET_WIFI_NETWORKS, 1, ImprovTypes::NETWORK_LIST_COMPACT, 0};
+  ImprovTypes::ImprovCommandView cmd;
+
+  CHECK(ImprovRpcDecoder::decode(data, 3, cmd));
+  CHECK_EQ(cmd.command, ImprovTypes::GET_WIFI_NETWORKS);
+  CHECK_EQ(cmd.dataLength, 1);
+  CHECK_EQ(cmd.data[0], ImprovTypes::NETWORK_LIST_COMPACT);
+  CHECK(cmd.ssid == nullptr);
+}
+
+TEST(decodes_the_payload_of_the_assembler)
+{
+  std::vector<uint8_t> payload = wifiSettings("Net", "password");
+  payload.pop_back();
+  std::vector<uint8_t> frame = {'I', 'M', 'P', 'R', 'O', 'V', 1, ImprovTypes::TYPE_RPC, (uint8_t)payload.size()};
+  frame.insert(frame.end(), payload.begin(), payload.end());
+  uint8_t checksum = 0;
+  for (uint8_t b : frame)
+    checksum += b;
+  frame.push_back(checksum);
+
+  ImprovFrameAssembler assembler;
+  ImprovFrameAssembler::Result result = ImprovFrameAssembler::FRAME_INCOMPLETE;
+  for (uint8_t b : frame)
+    result = assembler.push(b);
+  CHECK_EQ(result, ImprovFrameAssembler::FRAME_COMPLETE);
+
+  ImprovTypes::ImprovCommandView cmd;
+  CHECK(ImprovRpcDecoder::decode(assembler.payload(), assembler.payloadLength(), cmd));
+  CHECK(std::string(cmd.password, cmd.passwordLength) == "password");
+}
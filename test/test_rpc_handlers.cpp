@@ -0,0 +1,154 @@
+#include "ImprovFixture.h"
+#include "ImprovTest.h"
+
+using ImprovHost::Frame;
+
+static const uint8_t VENDOR_COMMAND = 0xF1;
+
+static std::vector<Frame> responses(const std::vector<Frame> &frames)
+{
+  std::vector<Frame> result;
+  for (const Frame &frame : frames)
+  {
+    if (frame.type == ImprovTypes::TYPE_RPC_RESPONSE)
+      result.push_back(frame);
+  }
+  return result;
+}
+
+TEST(custom_wifi_settings_handler_sees_the_frame_unmodified)
+{
+  ImprovFixture f;
+  std::vector<uint8_t> data;
+  std::string ssid, password;
+  f.improv.registerRpcHandler(ImprovTypes::WIFI_SETTINGS, [&](const ImprovTypes::ImprovCommandView &cmd, ImprovResponseEncoder &) {
+    data.assign(cmd.data, cmd.data + cmd.dataLength);
+    ssid.assign(cmd.ssid, cmd.ssidLength);
+    password.assign(cmd.password, cmd.passwordLength);
+    return true;
+  });
+
+  f.request(ImprovHost::rpc(ImprovTypes::WIFI_SETTINGS, std::vector<std::string>{"MyNet", "secret123"}));
+
+  std::vector<uint8_t> expected = {5, 'M', 'y', 'N', 'e', 't', 9, 's', 'e', 'c', 'r', 'e', 't', '1', '2', '3'};
+  CHECK(data == expected);
+  CHECK(ssid == "MyNet");
+  CHECK(password == "secret123");
+}
+
+TEST(handler_without_strings_acknowledges_the_command)
+{
+  ImprovFixture f;
+  f.improv.registerRpcHandler(VENDOR_COMMAND, [](const ImprovTypes::ImprovCommandView &, ImprovResponseEncoder &) { return true; });
+
+  std::vector<Frame> frames = responses(f.request(ImprovHost::rpc(VENDOR_COMMAND)));
+
+  CHECK_EQ(frames.size(), (size_t)1);
+  CHECK(frames.size() == 1 && frames[0].payload == (std::vector<uint8_t>{VENDOR_COMMAND, 0}));
+}
+
+TEST(handler_strings_are_sent)
+{
+  ImprovFixture f;
+  f.improv.registerRpcHandler(VENDOR_COMMAND, [](const ImprovTypes::ImprovCommandView &, ImprovResponseEncoder &response) {
+    response.add("a");
+    response.add("bc");
+    return true;
+  });
+
+  std::vector<Frame> frames = responses(f.request(ImprovHost::rpc(VENDOR_COMMAND)));
+
+  CHECK_EQ(frames.size(), (size_t)1);
+  CHECK(frames.size() == 1 && ImprovHost::strings(frames[0]) == (std::vector<std::string>{"a", "bc"}));
+}
+
+TEST(failed_handler_sends_nothing)
+{
+  ImprovFixture f;
+  f.improv.registerRpcHandler(VENDOR_COMMAND, [](const ImprovTypes::ImprovCommandView &, ImprovResponseEncoder &response) {
+    response.add("ignored");
+    return false;
+  });
+
+  CHECK(f.request(ImprovHost::rpc(VENDOR_COMMAND)).empty());
+}
+
+TEST(handler_error_and_overflow_are_reported)
+{
+  ImprovFixture f;
+  f.improv.registerRpcHandler(VENDOR_COMMAND, [](const ImprovTypes::ImprovCommandView &, ImprovResponseEncoder &response) {
+    return response.fail(ImprovTypes::ERROR_INVALID_RPC);
+  });
+  f.improv.registerRpcHandler(VENDOR_COMMAND + 1, [](const ImprovTypes::ImprovCommandView &, ImprovResponseEncoder &response) {
+    std::string chunk(200, 'x');
+    response.add(chunk);
+    response.add(chunk);
+    return true;
+  });
+
+  std::vector<Frame> frames = f.request(ImprovHost::rpc(VENDOR_COMMAND));
+  CHECK(frames.size() == 1 && isError(frames[0], ImprovTypes::ERROR_INVALID_RPC));
+
+  frames = f.request(ImprovHost::rpc(VENDOR_COMMAND + 1));
+  CHECK(frames.size() == 1 && isError(frames[0], ImprovTypes::ERROR_UNKNOWN));
+}
+
+TEST(handler_can_replace_and_remove_itself)
+{
+  ImprovFixture f;
+  int calls = 0;
+  f.improv.registerRpcHandler(VENDOR_COMMAND, [&](const ImprovTypes::ImprovCommandView &, ImprovResponseEncoder &response) {
+    // the captures of this lambda are destroyed by the replacement, the copy keeps them alive
+    std::string payload(64, 'p');
+    f.improv.registerRpcHandler(VENDOR_COMMAND, [&, payload](const ImprovTypes::ImprovCommandView &, ImprovResponseEncoder &) {
+      calls += 10;
+      f.improv.registerRpcHandler(VENDOR_COMMAND, nullptr);
+      return payload.size() == 64;
+    });
+    // more handlers can grow the table
+    for (uint8_t command = VENDOR_COMMAND + 1; command < 0xFF; command++)
+      f.improv.registerRpcHandler(command, [](const ImprovTypes::ImprovCommandView &, ImprovResponseEncoder &) { return true; });
+    calls++;
+    return response.add(payload);
+  });
+
+  CHECK_EQ(responses(f.request(ImprovHost::rpc(VENDOR_COMMAND))).size(), (size_t)1);
+  CHECK_EQ(responses(f.request(ImprovHost::rpc(VENDOR_COMMAND))).size(), (size_t)1);
+  CHECK_EQ(calls, 11);
+
+  // removed: the command is unknown now
+  std::vector<Frame> frames = f.request(ImprovHost::rpc(VENDOR_COMMAND));
+  CHECK(frames.size() == 1 && isError(frames[0], ImprovTypes::ERROR_UNKNOWN_RPC));
+}
+
+TEST(builtin_commands_send_a_single_response)
+{
+  ImprovFixture f;
+
+  std::vector<Frame> frames = responses(f.request(ImprovHost::rpc(ImprovTypes::GET_DEVICE_INFO)));
+  CHECK_EQ(frames.size(), (size_t)1);
+
+  frames = f.request(ImprovHost::rpc(ImprovTypes::GET_CURRENT_STATE));
+  CHECK_EQ(responses(frames).size(), (size_t)0);
+  CHECK(frames.size() == 1 && isState(frames[0], ImprovTypes::STATE_AUTHORIZED));
+}
+
+TEST(nested_dispatch_keeps_the_outer_response)
+{
+  ImprovFixture f;
+  std::vector<uint8_t> inner = ImprovHost::rpc(VENDOR_COMMAND + 1);
+  f.improv.registerRpcHandler(VENDOR_COMMAND, [&](const ImprovTypes::ImprovCommandView &, ImprovResponseEncoder &response) {
+    // answers on its own and, like the blocking waits of the built-in commands, processes a frame meanwhile
+    response.skip();
+    f.improv.handleBuffer(inner.data(), inner.size());
+    return response.add("outer");
+  });
+  f.improv.registerRpcHandler(VENDOR_COMMAND + 1, [](const ImprovTypes::ImprovCommandView &, ImprovResponseEncoder &response) {
+    return response.add("inner");
+  });
+
+  std::vector<Frame> frames = responses(f.request(ImprovHost::rpc(VENDOR_COMMAND)));
+
+  CHECK_EQ(frames.size(), (size_t)1);
+  CHECK(frames.size() == 1 && ImprovHost::strings(frames[0]) == std::vector<std::string>{"inner"});
+}
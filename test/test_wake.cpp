@@ -0,0 +1,97 @@
+#include <cstring>
+
+#include "ImprovFixture.h"
+#include "ImprovTest.h"
+
+using ImprovHost::Frame;
+
+// device whose listener went dormant
+struct DormantFixture : ImprovFixture
+{
+  explicit DormantFixture(const char *wakeSequence = nullptr)
+  {
+    improv.setWakeSequence(wakeSequence);
+    device.clock->sleep(IMPROV_RUN_FOR);
+  }
+
+  // one loop() per chunk, as if the chunks arrived in separate reads
+  std::vector<Frame> receive(const std::vector<std::vector<uint8_t>> &chunks)
+  {
+    for (const std::vector<uint8_t> &chunk : chunks)
+    {
+      serial.send(chunk);
+      improv.loop();
+    }
+    return ImprovHost::parse(serial.take());
+  }
+};
+
+static std::vector<uint8_t> bytes(const char *text)
+{
+  return std::vector<uint8_t>(text, text + strlen(text));
+}
+
+static bool isAuthorized(const std::vector<Frame> &frames)
+{
+  return frames.size() == 1 && isState(frames[0], ImprovTypes::STATE_AUTHORIZED);
+}
+
+TEST(wake_sequence_split_across_reads)
+{
+  DormantFixture f("WAKEUP");
+  CHECK(f.improv.isDormant());
+
+  CHECK(f.receive({bytes("log line\r\nWAK")}).empty());
+  CHECK(f.improv.isDormant());
+  CHECK(f.receive({bytes("EUP")}).empty());
+  CHECK(!f.improv.isDormant());
+
+  CHECK(isAuthorized(f.request(ImprovHost::rpc(ImprovTypes::GET_CURRENT_STATE))));
+}
+
+TEST(partial_match_falls_back_to_the_prefix)
+{
+  // "ABA" fails at the fourth byte, which still continues the prefix "AB"
+  DormantFixture f("ABAC");
+  CHECK(f.receive({bytes("xxABABAC")}).empty());
+  CHECK(!f.improv.isDormant());
+
+  // with the default sequence: a broken header right before the frame
+  DormantFixture g;
+  std::vector<uint8_t> data = bytes("IMPRIMP");
+  std::vector<uint8_t> frame = ImprovHost::rpc(ImprovTypes::GET_CURRENT_STATE);
+  data.insert(data.end(), frame.begin(), frame.end());
+  CHECK(isAuthorized(g.receive({data})));
+}
+
+TEST(custom_sequence_blocks_plain_frames)
+{
+  DormantFixture f("WAKEUP");
+  std::vector<uint8_t> frame = ImprovHost::rpc(ImprovTypes::GET_CURRENT_STATE);
+
+  CHECK(f.receive({frame}).empty());
+  CHECK(f.improv.isDormant());
+
+  std::vector<uint8_t> data = bytes("WAKEUP");
+  data.insert(data.end(), frame.begin(), frame.end());
+  CHECK(isAuthorized(f.receive({data})));
+}
+
+TEST(default_sequence_passes_frames_unchanged)
+{
+  std::vector<uint8_t> frame = ImprovHost::rpc(ImprovTypes::GET_DEVICE_INFO);
+  ImprovFixture awake;
+  std::vector<Frame> expected = awake.request(frame);
+  CHECK_EQ(expected.size(), 1u);
+
+  // the frame split at every position, the header as well
+  for (size_t split = 0; split <= frame.size(); split++)
+  {
+    DormantFixture f;
+    std::vector<uint8_t> first(frame.begin(), frame.begin() + split);
+    std::vector<uint8_t> second(frame.begin() + split, frame.end());
+    std::vector<Frame> frames = f.receive({first, second});
+    CHECK(frames.size() == 1 && frames[0].type == expected[0].type && frames[0].payload == expected[0].payload);
+    CHECK(!f.improv.isDormant());
+  }
+}